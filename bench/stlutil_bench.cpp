@@ -0,0 +1,401 @@
+/**
+ * @file stlutil_bench.cpp
+ * @brief stlutil の読み込みとスライスのベンチマーク
+ * @details Google Benchmark を使います．ビルドと実行は次のとおりです．
+ *
+ *     g++ -std=c++17 -O2 -I.. stlutil_bench.cpp -o stlutil_bench -lbenchmark -pthread
+ *     ./stlutil_bench --benchmark_filter=Slice
+ *
+ * 既定では100万ポリゴンまでのメッシュを使います．環境変数 STLUTIL_BENCH_LARGE=1 を設定すると
+ * 1000万・5000万ポリゴンのメッシュも使います (数GBのメモリと一時ファイルが必要です)．
+ * 一時ファイルは環境変数 STLUTIL_BENCH_DIR (既定はシステムの一時ディレクトリ) に作られます．
+ */
+#include <benchmark/benchmark.h>
+
+#include "stlutil.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    std::atomic<std::size_t> allocations { 0 }; // operator new が呼ばれた回数
+
+}
+
+[[gnu::noinline]] void *operator new(const std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// インライン展開されると operator new との組み合わせについて誤った警告が出るため，展開させない
+[[gnu::noinline]] void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    using stlutil::STLPolygon;
+    using stlutil::STLVector;
+
+    constexpr float pi = 3.14159265358979f;
+
+    /**
+     * 測定中の operator new の回数を1回あたりのカウンタとして記録します
+     */
+    struct AllocationCounter {
+        benchmark::State &state; // 記録先
+        std::size_t start = allocations.load(std::memory_order_relaxed); // 測定を始めたときの回数
+
+        ~AllocationCounter() {
+            state.counters["allocs"] = benchmark::Counter(
+                static_cast<double>(allocations.load(std::memory_order_relaxed) - start),
+                benchmark::Counter::kAvgIterations
+            );
+        }
+    };
+
+    /**
+     * 球面のメッシュを作ります
+     * @param triangles ポリゴンの数の目安
+     */
+    std::vector<STLPolygon> make_sphere(const std::size_t triangles) {
+        const auto n = static_cast<std::size_t>(std::max(2.0, std::sqrt(triangles / 2.0)));
+        const float radius = 50;
+        const auto vertex = [n, radius](const std::size_t i, const std::size_t j) {
+            const float theta = pi * static_cast<float>(i) / static_cast<float>(n);
+            const float phi = 2 * pi * static_cast<float>(j % n) / static_cast<float>(n);
+            return STLVector { radius * std::sin(theta) * std::cos(phi), radius * std::sin(theta) * std::sin(phi), radius * std::cos(theta) };
+        };
+        std::vector<STLPolygon> polygons;
+        polygons.reserve(2 * n * n);
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                polygons.push_back({ {}, vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+                polygons.push_back({ {}, vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+            }
+        }
+        return polygons;
+    }
+
+    /**
+     * 起伏のある地形のメッシュを作ります
+     * @param triangles ポリゴンの数の目安
+     */
+    std::vector<STLPolygon> make_terrain(const std::size_t triangles) {
+        const auto n = static_cast<std::size_t>(std::max(1.0, std::sqrt(triangles / 2.0)));
+        const float size = 100;
+        const auto vertex = [n, size](const std::size_t i, const std::size_t j) {
+            const float x = size * static_cast<float>(i) / static_cast<float>(n);
+            const float y = size * static_cast<float>(j) / static_cast<float>(n);
+            return STLVector { x, y, 5 * std::sin(x * 0.13f) * std::cos(y * 0.07f) + 2 * std::sin(x * 0.71f + y * 0.37f) };
+        };
+        std::vector<STLPolygon> polygons;
+        polygons.reserve(2 * n * n);
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                polygons.push_back({ {}, vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1) });
+                polygons.push_back({ {}, vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1) });
+            }
+        }
+        return polygons;
+    }
+
+    /**
+     * 細かく分割した直方体の建物を格子状に並べたメッシュを作ります
+     * @param triangles ポリゴンの数の目安
+     */
+    std::vector<STLPolygon> make_buildings(const std::size_t triangles) {
+        constexpr std::size_t split = 4; // 1つの面の分割数
+        constexpr std::size_t per_building = 6 * 2 * split * split;
+        const auto n = static_cast<std::size_t>(std::max(1.0, std::sqrt(static_cast<double>(triangles) / per_building)));
+        std::vector<STLPolygon> polygons;
+        polygons.reserve(n * n * per_building);
+        for (std::size_t bx = 0; bx < n; ++bx) {
+            for (std::size_t by = 0; by < n; ++by) {
+                const STLVector lo { 30.0f * bx, 30.0f * by, 0 };
+                const STLVector hi { lo.x + 20, lo.y + 20, 10.0f + 7.0f * ((bx * 7 + by * 13) % 9) };
+                // 面ごとに原点と2辺を決めて分割する
+                const STLVector ex { hi.x - lo.x, 0, 0 }, ey { 0, hi.y - lo.y, 0 }, ez { 0, 0, hi.z - lo.z };
+                const std::pair<STLVector, std::pair<STLVector, STLVector>> faces[6] = {
+                    { lo, { ey, ex } }, { { lo.x, lo.y, hi.z }, { ex, ey } },
+                    { lo, { ex, ez } }, { { lo.x, hi.y, lo.z }, { ez, ex } },
+                    { lo, { ez, ey } }, { { hi.x, lo.y, lo.z }, { ey, ez } }
+                };
+                for (const auto &[ origin, edges ] : faces) {
+                    const auto &[ u, v ] = edges;
+                    const auto point = [&origin, &u, &v](const std::size_t i, const std::size_t j) {
+                        const float s = static_cast<float>(i) / split, t = static_cast<float>(j) / split;
+                        return STLVector { origin.x + s * u.x + t * v.x, origin.y + s * u.y + t * v.y, origin.z + s * u.z + t * v.z };
+                    };
+                    for (std::size_t i = 0; i < split; ++i) {
+                        for (std::size_t j = 0; j < split; ++j) {
+                            polygons.push_back({ {}, point(i, j), point(i + 1, j), point(i + 1, j + 1) });
+                            polygons.push_back({ {}, point(i, j), point(i + 1, j + 1), point(i, j + 1) });
+                        }
+                    }
+                }
+            }
+        }
+        return polygons;
+    }
+
+    using Generator = std::vector<STLPolygon> (*)(std::size_t);
+
+    /**
+     * メッシュの種類
+     */
+    struct MeshKind {
+        const char *name; // ベンチマーク名に付ける名前
+        Generator generate; // メッシュを作る関数
+    };
+
+    const MeshKind mesh_kinds[] = {
+        { "sphere", make_sphere },
+        { "terrain", make_terrain },
+        { "buildings", make_buildings }
+    };
+
+    /**
+     * 種類と大きさごとに作ったメッシュを保持します
+     * @details 大きなメッシュを何度も作らないように，最後に使った1つだけを保持します
+     */
+    const std::vector<STLPolygon> &mesh(const MeshKind &kind, const std::size_t triangles) {
+        static std::pair<std::string, std::size_t> key;
+        static std::vector<STLPolygon> polygons;
+        if (key.first != kind.name || key.second != triangles) {
+            polygons = {};
+            polygons = kind.generate(triangles);
+            key = { kind.name, triangles };
+        }
+        return polygons;
+    }
+
+    /**
+     * バイナリSTLファイルを書き出します
+     */
+    void write_binary(const std::string &path, const std::vector<STLPolygon> &polygons) {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        const char header[stlutil::internal::stl_header_size] = "stlutil benchmark";
+        file.write(header, sizeof(header));
+        const auto count = static_cast<std::uint32_t>(polygons.size());
+        char record[stlutil::internal::stl_record_size] = {};
+        std::memcpy(record, &count, sizeof(count)); // 実行環境はリトルエンディアンを仮定する
+        file.write(record, sizeof(count));
+        std::memset(record, 0, sizeof(record));
+        for (const auto &polygon : polygons) {
+            std::memcpy(record, &polygon, 48);
+            file.write(record, sizeof(record));
+        }
+    }
+
+    /**
+     * ASCII STLファイルを書き出します
+     */
+    void write_ascii(const std::string &path, const std::vector<STLPolygon> &polygons) {
+        std::FILE *file = std::fopen(path.c_str(), "w");
+        std::fputs("solid benchmark\n", file);
+        for (const auto& [ n, a, b, c ] : polygons) {
+            std::fprintf(file, "facet normal %g %g %g\nouter loop\n", n.x, n.y, n.z);
+            for (const STLVector *v : { &a, &b, &c }) {
+                std::fprintf(file, "vertex %.7g %.7g %.7g\n", v->x, v->y, v->z);
+            }
+            std::fputs("endloop\nendfacet\n", file);
+        }
+        std::fputs("endsolid benchmark\n", file);
+        std::fclose(file);
+    }
+
+    /**
+     * ベンチマーク中だけ存在する一時ファイル
+     */
+    struct TemporaryFile {
+        std::string path; // ファイルへのパス
+
+        explicit TemporaryFile(const std::string &name) {
+            const char *dir = std::getenv("STLUTIL_BENCH_DIR");
+            path = ((dir != nullptr ? std::filesystem::path(dir) : std::filesystem::temp_directory_path()) / name).string();
+        }
+
+        ~TemporaryFile() {
+            std::remove(path.c_str());
+        }
+    };
+
+    void load_binary(benchmark::State &state, const MeshKind &kind, const std::size_t triangles, const unsigned int threads) {
+        TemporaryFile file(std::string("stlutil_bench_") + kind.name + ".stl");
+        write_binary(file.path, mesh(kind, triangles));
+        const auto bytes = std::filesystem::file_size(file.path);
+        stlutil::STLReadOptions options;
+        options.threads = threads;
+        AllocationCounter counter { state };
+        for (auto _ : state) {
+            const stlutil::STLReader reader(file.path, options);
+            benchmark::DoNotOptimize(reader.polygons().data());
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytes));
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * mesh(kind, triangles).size()));
+    }
+
+    void load_ascii(benchmark::State &state, const MeshKind &kind, const std::size_t triangles) {
+        TemporaryFile file(std::string("stlutil_bench_") + kind.name + "_ascii.stl");
+        write_ascii(file.path, mesh(kind, triangles));
+        const auto bytes = std::filesystem::file_size(file.path);
+        AllocationCounter counter { state };
+        for (auto _ : state) {
+            const stlutil::STLReader reader(file.path);
+            benchmark::DoNotOptimize(reader.polygons().data());
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytes));
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * mesh(kind, triangles).size()));
+    }
+
+    void write_binary_stl(benchmark::State &state, const MeshKind &kind, const std::size_t triangles, const unsigned int threads) {
+        TemporaryFile file(std::string("stlutil_bench_") + kind.name + "_write.stl");
+        const auto &polygons = mesh(kind, triangles);
+        stlutil::STLWriteOptions options;
+        options.threads = threads;
+        AllocationCounter counter { state };
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(stlutil::write_stl(file.path, polygons, {}, options));
+        }
+        const auto bytes = std::filesystem::file_size(file.path);
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytes));
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * polygons.size()));
+    }
+
+    /**
+     * スライスのベンチマーク
+     * @param slice メッシュと平面の番号を受け取り，線分の配列を返す関数
+     * @details 平面の位置はメッシュの範囲内で反復ごとに変えます
+     */
+    template <class Mesh, class Slice>
+    void slice(benchmark::State &state, const Mesh &target, const std::size_t triangles, Slice &&slice) {
+        AllocationCounter counter { state };
+        std::size_t k = 0, segments = 0;
+        for (auto _ : state) {
+            const auto &res = slice(target, static_cast<float>(k++ % 16) / 16);
+            segments += res.size();
+            benchmark::DoNotOptimize(res.data());
+        }
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * triangles));
+        state.counters["segments"] = benchmark::Counter(static_cast<double>(segments), benchmark::Counter::kAvgIterations);
+    }
+
+    /**
+     * @param lo 範囲の最小値
+     * @param hi 範囲の最大値
+     * @param t 0以上1未満の値
+     * @return 範囲の内分点
+     */
+    float lerp(const float lo, const float hi, const float t) {
+        return lo + (hi - lo) * (0.05f + 0.9f * t);
+    }
+
+    void register_benchmarks(const MeshKind &kind, const std::size_t triangles) {
+        const std::string suffix = std::string("/") + kind.name + "/" + std::to_string(triangles);
+        const MeshKind *k = &kind;
+
+        benchmark::RegisterBenchmark(("Load/binary" + suffix).c_str(), [k, triangles](benchmark::State &state) {
+            load_binary(state, *k, triangles, 1);
+        })->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Load/binary_parallel" + suffix).c_str(), [k, triangles](benchmark::State &state) {
+            load_binary(state, *k, triangles, 0);
+        })->Unit(benchmark::kMillisecond);
+        if (triangles <= 1000000) {
+            benchmark::RegisterBenchmark(("Load/ascii" + suffix).c_str(), [k, triangles](benchmark::State &state) {
+                load_ascii(state, *k, triangles);
+            })->Unit(benchmark::kMillisecond);
+        }
+
+        benchmark::RegisterBenchmark(("Write/binary" + suffix).c_str(), [k, triangles](benchmark::State &state) {
+            write_binary_stl(state, *k, triangles, 1);
+        })->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("Write/binary_parallel" + suffix).c_str(), [k, triangles](benchmark::State &state) {
+            write_binary_stl(state, *k, triangles, 0);
+        })->Unit(benchmark::kMillisecond);
+
+        // 平面の位置を決めるためにメッシュを囲む直方体を使う
+        const auto bounds = [k, triangles] {
+            return stlutil::bounding_box(mesh(*k, triangles));
+        };
+        benchmark::RegisterBenchmark(("Slice/x" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            slice(state, mesh(*k, triangles), triangles, [&box](const auto &polygons, const float t) {
+                return stlutil::slice_polygons_at_x(polygons, lerp(box.min.x, box.max.x, t));
+            });
+        })->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Slice/y" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            slice(state, mesh(*k, triangles), triangles, [&box](const auto &polygons, const float t) {
+                return stlutil::slice_polygons_at_y(polygons, lerp(box.min.y, box.max.y, t));
+            });
+        })->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Slice/z" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            slice(state, mesh(*k, triangles), triangles, [&box](const auto &polygons, const float t) {
+                return stlutil::slice_polygons_at_z(polygons, lerp(box.min.z, box.max.z, t));
+            });
+        })->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Slice/plane" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            slice(state, mesh(*k, triangles), triangles, [&box](const auto &polygons, const float t) {
+                // z軸から傾けた平面を直方体の中心付近に置く
+                const float z = lerp(box.min.z, box.max.z, t);
+                const float cx = (box.min.x + box.max.x) / 2, cy = (box.min.y + box.max.y) / 2;
+                return stlutil::slice_polygons_at(polygons, 0.3f, 0.2f, 1, -(0.3f * cx + 0.2f * cy + z));
+            });
+        })->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Slice/z_soa" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            const stlutil::STLMeshSoA soa(mesh(*k, triangles));
+            slice(state, soa, triangles, [&box](const auto &polygons, const float t) {
+                return stlutil::slice_polygons_at_z(polygons, lerp(box.min.z, box.max.z, t));
+            });
+        })->Unit(benchmark::kMicrosecond);
+        benchmark::RegisterBenchmark(("Slice/z_reuse" + suffix).c_str(), [k, triangles, bounds](benchmark::State &state) {
+            const auto box = bounds();
+            std::vector<stlutil::STLSegment> res;
+            slice(state, mesh(*k, triangles), triangles, [&box, &res](const auto &polygons, const float t) -> const auto & {
+                stlutil::slice_polygons_at_z(polygons, lerp(box.min.z, box.max.z, t), res);
+                return res;
+            });
+        })->Unit(benchmark::kMicrosecond);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::size_t> sizes = { 1000, 100000, 1000000 };
+    const char *large = std::getenv("STLUTIL_BENCH_LARGE");
+    if (large != nullptr && std::string(large) != "0") {
+        sizes.push_back(10000000);
+        sizes.push_back(50000000);
+    }
+    for (const std::size_t triangles : sizes) {
+        for (const auto &kind : mesh_kinds) {
+            register_benchmarks(kind, triangles);
+        }
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file stlutil_cuda_parity.cu
+ * @brief stlutil_cuda.cuh のスライスがCPUの結果と一致するかを確認するプログラム
+ * @details GPUのある環境で次のようにビルドして実行します．全ての平面で線分の集合が一致すれば終了コード0を返します．
+ *
+ *     nvcc -std=c++17 -O2 -I.. stlutil_cuda_parity.cu -o stlutil_cuda_parity
+ *     ./stlutil_cuda_parity                 # 合成した球面のメッシュを使う
+ *     ./stlutil_cuda_parity path/to/your/stl
+ *
+ * 成分ごとの配列と頂点を共有した配列の両方の形式で転送して確認します．
+ */
+#include "stlutil_cuda.cuh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using stlutil::STLPolygon;
+    using stlutil::STLSegment;
+    using stlutil::STLVector;
+
+    /**
+     * 単位球面を分割したメッシュを作ります
+     * @param n 経度と緯度の分割数
+     * @return ポリゴンの配列
+     */
+    std::vector<STLPolygon> sphere(const int n) {
+        const auto point = [](const float theta, const float phi) {
+            return STLVector { std::cos(theta) * std::sin(phi), std::sin(theta) * std::sin(phi), std::cos(phi) };
+        };
+        std::vector<STLPolygon> polygons;
+        polygons.reserve(2 * static_cast<std::size_t>(n) * n);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                const float t0 = 6.2831853f * i / n, t1 = 6.2831853f * (i + 1) / n;
+                const float p0 = 3.1415927f * j / n, p1 = 3.1415927f * (j + 1) / n;
+                polygons.push_back({ { 0, 0, 0 }, point(t0, p0), point(t1, p0), point(t1, p1) });
+                polygons.push_back({ { 0, 0, 0 }, point(t0, p0), point(t1, p1), point(t0, p1) });
+            }
+        }
+        return polygons;
+    }
+
+    /**
+     * 線分をバイト列の順に並べます (GPUの結果は平面ごとの順序が不定なので，並べてから比べる)
+     */
+    void sort_segments(std::vector<STLSegment> &segments) {
+        std::sort(segments.begin(), segments.end(), [](const STLSegment &a, const STLSegment &b) {
+            return std::memcmp(&a, &b, sizeof(STLSegment)) < 0;
+        });
+    }
+
+    /**
+     * GPUでスライスした結果をCPUの結果と比べます
+     * @return 全ての平面で一致すればtrue
+     */
+    bool compare(
+        const char *name,
+        const stlutil::cuda::STLCudaMesh &mesh,
+        const std::vector<float> &levels,
+        const std::vector<std::vector<STLSegment>> &expected
+    ) {
+        std::vector<std::vector<STLSegment>> actual;
+        if (!mesh || !mesh.slice_at_z_levels(levels, actual) || actual.size() != expected.size()) {
+            std::printf("%s: slice failed\n", name);
+            return false;
+        }
+        std::size_t total = 0, mismatches = 0;
+        for (std::size_t k = 0; k < levels.size(); ++k) {
+            auto a = actual[k];
+            auto b = expected[k];
+            sort_segments(a);
+            sort_segments(b);
+            total += b.size();
+            if (a.size() != b.size() || std::memcmp(a.data(), b.data(), a.size() * sizeof(STLSegment)) != 0) {
+                if (mismatches++ < 10) {
+                    std::printf("%s: z = %g: %zu segments, expected %zu\n", name, levels[k], a.size(), b.size());
+                }
+            }
+        }
+        std::printf("%s: %zu levels, %zu segments, %zu mismatched levels\n", name, levels.size(), total, mismatches);
+        return mismatches == 0;
+    }
+
+}
+
+int main(const int argc, char **argv) {
+    std::vector<STLPolygon> polygons;
+    if (argc > 1) {
+        stlutil::STLReader reader(argv[1]);
+        if (!reader) {
+            return 1;
+        }
+        polygons = reader.release_polygons();
+    } else {
+        polygons = sphere(500);
+    }
+
+    // 範囲の外側と頂点の高さちょうどの平面も含め，順序を崩して与える
+    const auto box = stlutil::bounding_box(polygons);
+    std::vector<float> levels;
+    for (int k = 0; k <= 256; ++k) {
+        levels.push_back(box.min.z - 0.05f + (box.max.z - box.min.z + 0.1f) * k / 256);
+    }
+    std::reverse(levels.begin(), levels.begin() + 64);
+    if (!polygons.empty()) {
+        levels.push_back(polygons[polygons.size() / 2].a.z);
+    }
+    const auto expected = stlutil::slice_polygons_at_z_levels(polygons, levels);
+
+    const bool soa = compare("soa", stlutil::cuda::STLCudaMesh(polygons), levels, expected);
+    const bool indexed = compare("indexed", stlutil::cuda::STLCudaMesh(stlutil::STLIndexedMesh(polygons)), levels, expected);
+    return soa && indexed ? 0 : 1;
+}
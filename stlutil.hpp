@@ -9,6 +9,58 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <iterator>
+#include <utility>
+#include <thread>
+#include <numeric>
+#include <cmath>
+#include <unordered_map>
+#include <list>
+#include <charconv>
+#include <string_view>
+#include <cstdlib>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <exception>
+#include <system_error>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define STLUTIL_HAS_MMAP 1
+#endif
+
+// STLUTIL_NO_SIMD を定義するとSIMDによるスライスを無効にします
+// nvcc のフロントエンドは target 属性付きの関数や immintrin.h を解釈できない場合があるので，CUDAのコンパイルでは常に無効にします
+#if defined(__CUDACC__) && !defined(STLUTIL_NO_SIMD)
+#define STLUTIL_NO_SIMD
+#endif
+#ifndef STLUTIL_NO_SIMD
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define STLUTIL_SIMD_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STLUTIL_SIMD_NEON 1
+#endif
+#endif
+
+// STLUTIL_ENABLE_INSTRUMENTATION を定義すると読み込みとスライスの計測を有効にします
+#ifdef STLUTIL_ENABLE_INSTRUMENTATION
+#include <chrono>
+#endif
 
 namespace stlutil {
 
@@ -41,231 +93,5884 @@ namespace stlutil {
     };
 
     /**
-     * STLファイルのデータを保持する構造体
+     * 座標軸に平行な直方体を表す構造体
      */
-    struct STLReader {
-    private:
-        std::string header_; // STLファイルの先頭80byte
-        std::vector<STLPolygon> polygons_; // ポリゴンの配列
+    struct STLBoundingBox {
+        STLVector min; // 各座標の最小値
+        STLVector max; // 各座標の最大値
+    };
 
-        bool valid = false; // 読み取りが正常に行えたかどうか
+    /**
+     * ポリゴンごとの座標軸に平行な包含箱を，成分ごとの配列で保持する構造体
+     */
+    struct STLPolygonBounds {
+        std::vector<float> min_x, min_y, min_z; // ポリゴンごとの各座標の最小値
+        std::vector<float> max_x, max_y, max_z; // ポリゴンごとの各座標の最大値
+        STLBoundingBox mesh {
+            { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() },
+            { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() }
+        }; // 全てのポリゴンを囲む直方体．ポリゴンが無ければ min が +inf, max が -inf
 
-    public:
-        STLReader(const STLReader&) = delete;
+        /**
+         * @return 包含箱を保持しているポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return min_x.size();
+        }
 
         /**
-         * STLファイルを読み込んでポリゴンの読み出しを行ないます
-         * @param path 読み込むSTLファイルへのパス
+         * @return 包含箱を保持していなければtrue
          */
-        explicit STLReader(const std::string &path) {
-            std::ifstream stlfile(path, std::ios::in | std::ios::binary);
-            if (!stlfile) {
-                std::cerr << "STLReader::STLReader() Error: Cannot open file `" << path << "`." << std::endl;
-                return;
+        [[nodiscard]]
+        bool empty() const noexcept {
+            return min_x.empty();
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return ポリゴンを囲む直方体
+         */
+        [[nodiscard]]
+        STLBoundingBox box(const std::size_t i) const noexcept {
+            return { { min_x[i], min_y[i], min_z[i] }, { max_x[i], max_y[i], max_z[i] } };
+        }
+
+        /**
+         * ポリゴンの数に合わせて配列の大きさを変えます
+         * @param n ポリゴンの数
+         */
+        void resize(const std::size_t n) {
+            for (auto *v : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z }) {
+                v->resize(n);
+            }
+        }
+
+        /**
+         * 保持している包含箱を全て破棄します
+         */
+        void clear() noexcept {
+            for (auto *v : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z }) {
+                v->clear();
+                v->shrink_to_fit();
             }
-            stlfile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            mesh = { { inf, inf, inf }, { -inf, -inf, -inf } };
+        }
+    };
 
-            header_.resize(80);
-            stlfile.read(header_.data(), 80); // 先頭80byteの読み取り
-            uint32_t size;
-            stlfile.read(static_cast<char *>(static_cast<void *>(&size)), 4); // ポリゴンの数の読み取り
-            polygons_.resize(size);
-            for (auto& [ normal, a, b, c ] : polygons_) {
-                {
-                    auto& [ x, y, z ] = normal;
-                    // 法線ベクトルの読み取り
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&x)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&y)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&z)), 4);
-                }
-                {
-                    auto& [ x, y, z ] = a;
-                    // 三角形の頂点1の読み取り
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&x)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&y)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&z)), 4);
-                }
-                {
-                    auto& [ x, y, z ] = b;
-                    // 三角形の頂点2の読み取り
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&x)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&y)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&z)), 4);
+    /**
+     * 読み込みとスライスの計測値
+     * @details STLUTIL_ENABLE_INSTRUMENTATION を定義した場合のみ集計され，定義しなければ常に0です．
+     * 複数のスレッドで処理した場合，時間はスレッドごとの時間の合計になります
+     */
+    struct STLMetrics {
+        std::uint64_t open_ns = 0; // ファイルを開くのにかかった時間 [ns]
+        std::uint64_t header_ns = 0; // ヘッダの読み取りと検証にかかった時間 [ns]
+        std::uint64_t decode_ns = 0; // レコードの読み込みと変換にかかった時間 [ns]
+        std::uint64_t slice_ns = 0; // ポリゴンの配列のスライスにかかった時間 [ns]
+        std::uint64_t bytes_read = 0; // 読み込んだバイト数
+        std::uint64_t polygons_read = 0; // 読み込んだポリゴンの数
+        std::uint64_t triangles_tested = 0; // スライスで平面と比較した三角形の数 (複数の平面と比較した場合は平面ごとに数える)
+        std::uint64_t crossing_triangles = 0; // 平面をまたいだ三角形の数
+        std::uint64_t degenerate_segments = 0; // 長さが0か座標が NaN のため捨てた線分の数
+
+        /**
+         * 計測値を名前とともに順に渡します
+         * @param f (名前, 値) を受け取る関数．計測値を外部に送る場合などに使います
+         */
+        template <class F>
+        void for_each(F &&f) const {
+            f("open_ns", open_ns);
+            f("header_ns", header_ns);
+            f("decode_ns", decode_ns);
+            f("slice_ns", slice_ns);
+            f("bytes_read", bytes_read);
+            f("polygons_read", polygons_read);
+            f("triangles_tested", triangles_tested);
+            f("crossing_triangles", crossing_triangles);
+            f("degenerate_segments", degenerate_segments);
+        }
+    };
+
+    namespace internal {
+
+        /**
+         * 計測値の種類．STLMetrics のメンバと同じ順に並びます
+         */
+        enum class Metric {
+            open_ns, header_ns, decode_ns, slice_ns,
+            bytes_read, polygons_read, triangles_tested, crossing_triangles, degenerate_segments,
+            count // 種類の数
+        };
+
+#ifdef STLUTIL_ENABLE_INSTRUMENTATION
+        inline std::atomic<std::uint64_t> metric_values[static_cast<std::size_t>(Metric::count)] {}; // 計測値
+
+        /**
+         * 計測値に加算します
+         * @param metric 計測値の種類
+         * @param value 加算する値
+         */
+        static inline void add_metric(const Metric metric, const std::uint64_t value) noexcept {
+            metric_values[static_cast<std::size_t>(metric)].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        /**
+         * 作成から破棄までの時間を計測値に加算します
+         */
+        struct ScopedMetricTimer {
+            Metric metric; // 計測値の種類
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(); // 計測を始めた時刻
+
+            ~ScopedMetricTimer() {
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+                add_metric(metric, static_cast<std::uint64_t>(elapsed.count()));
+            }
+        };
+
+        /**
+         * スライスの計測値をスレッドごとに集める領域
+         * @details 三角形ごとに共有の計測値へアトミックに加算すると全てのスレッドが同じキャッシュラインを奪い合うので，
+         * スライスの呼び出しの間はここに加算し， ScopedSliceMetrics が呼び出しの終わりに1度だけ共有の計測値へ移します
+         */
+        struct SliceTally {
+            std::uint64_t triangles_tested = 0; // 平面と比較した三角形の数
+            std::uint64_t crossing_triangles = 0; // 平面をまたいだ三角形の数
+            std::uint64_t degenerate_segments = 0; // 捨てた線分の数
+            unsigned int depth = 0; // 入れ子になったスライスの呼び出しの深さ
+        };
+
+        inline thread_local SliceTally slice_tally; // このスレッドのスライスの計測値
+
+        /**
+         * スライスの呼び出しの時間を計り，終わりにスレッドごとの計測値を共有の計測値へ移します
+         * @details 入れ子になった呼び出しでは一番外側だけが計測するので，時間や件数を二重に数えません
+         */
+        struct ScopedSliceMetrics {
+            std::chrono::steady_clock::time_point start; // 計測を始めた時刻
+
+            ScopedSliceMetrics() noexcept {
+                if (slice_tally.depth++ == 0) {
+                    start = std::chrono::steady_clock::now();
                 }
-                {
-                    auto& [ x, y, z ] = c;
-                    // 三角形の頂点3の読み取り
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&x)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&y)), 4);
-                    stlfile.read(static_cast<char *>(static_cast<void *>(&z)), 4);
+            }
+
+            ScopedSliceMetrics(const ScopedSliceMetrics&) = delete;
+            ScopedSliceMetrics &operator=(const ScopedSliceMetrics&) = delete;
+
+            ~ScopedSliceMetrics() {
+                if (--slice_tally.depth != 0) {
+                    return;
                 }
-                stlfile.ignore(2); // 2byteスキップ
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+                add_metric(Metric::slice_ns, static_cast<std::uint64_t>(elapsed.count()));
+                add_metric(Metric::triangles_tested, std::exchange(slice_tally.triangles_tested, 0));
+                add_metric(Metric::crossing_triangles, std::exchange(slice_tally.crossing_triangles, 0));
+                add_metric(Metric::degenerate_segments, std::exchange(slice_tally.degenerate_segments, 0));
             }
+        };
 
-            valid = true;
+        /**
+         * 処理の段階ごとの時間を順に計測値に加算します
+         */
+        struct MetricStopwatch {
+            std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now(); // 前の段階が終わった時刻
+
+            /**
+             * 前の段階の終わりから現在までの時間を加算します
+             * @param metric 計測値の種類
+             */
+            void lap(const Metric metric) noexcept {
+                const auto now = std::chrono::steady_clock::now();
+                add_metric(metric, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count()));
+                last = now;
+            }
+        };
+#endif
+    }
+
+// 計測が無効な場合は引数も評価しない
+#ifdef STLUTIL_ENABLE_INSTRUMENTATION
+#define STLUTIL_METRIC_ADD(metric, value) ::stlutil::internal::add_metric(::stlutil::internal::Metric::metric, (value))
+#define STLUTIL_METRIC_TIMER(metric) const ::stlutil::internal::ScopedMetricTimer stlutil_timer_##metric { ::stlutil::internal::Metric::metric }
+#define STLUTIL_METRIC_SLICE() const ::stlutil::internal::ScopedSliceMetrics stlutil_slice_metrics {}
+#define STLUTIL_METRIC_COUNT(metric, value) (::stlutil::internal::slice_tally.metric += (value))
+#define STLUTIL_METRIC_STOPWATCH(name) ::stlutil::internal::MetricStopwatch name
+#define STLUTIL_METRIC_LAP(name, metric) name.lap(::stlutil::internal::Metric::metric)
+#else
+#define STLUTIL_METRIC_ADD(metric, value) ((void)0)
+#define STLUTIL_METRIC_TIMER(metric) ((void)0)
+#define STLUTIL_METRIC_SLICE() ((void)0)
+#define STLUTIL_METRIC_COUNT(metric, value) ((void)0)
+#define STLUTIL_METRIC_STOPWATCH(name) ((void)0)
+#define STLUTIL_METRIC_LAP(name, metric) ((void)0)
+#endif
+
+    /**
+     * @return これまでの計測値．STLUTIL_ENABLE_INSTRUMENTATION を定義していなければ全て0
+     */
+    [[nodiscard]]
+    inline STLMetrics metrics() noexcept {
+        STLMetrics res;
+#ifdef STLUTIL_ENABLE_INSTRUMENTATION
+        std::uint64_t *fields[] = {
+            &res.open_ns, &res.header_ns, &res.decode_ns, &res.slice_ns,
+            &res.bytes_read, &res.polygons_read, &res.triangles_tested, &res.crossing_triangles, &res.degenerate_segments
+        };
+        static_assert(std::size(fields) == static_cast<std::size_t>(internal::Metric::count));
+        for (std::size_t i = 0; i < std::size(fields); ++i) {
+            *fields[i] = internal::metric_values[i].load(std::memory_order_relaxed);
         }
+#endif
+        return res;
+    }
+
+    /**
+     * 計測値を全て0に戻します
+     */
+    inline void reset_metrics() noexcept {
+#ifdef STLUTIL_ENABLE_INSTRUMENTATION
+        for (auto &value : internal::metric_values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    namespace internal {
+
+        constexpr std::size_t stl_header_size = 80; // ヘッダの大きさ [byte]
+        constexpr std::size_t stl_count_size = 4;   // ポリゴン数の大きさ [byte]
+        constexpr std::size_t stl_record_size = 50; // ポリゴン1つあたりのレコードの大きさ [byte]
+        constexpr std::size_t stl_block_records = 8192; // 一度にまとめて読み込むレコードの数
+        constexpr std::size_t parallel_min_polygons = 65536; // 並列処理で1スレッドに割り当てる最小のポリゴン数
+
+        static_assert(std::numeric_limits<float>::is_iec559, "float must be IEEE 754 binary32");
+        static_assert(sizeof(STLVector) == 12 && std::is_trivially_copyable_v<STLVector>);
+        static_assert(sizeof(STLPolygon) == 48 && std::is_trivially_copyable_v<STLPolygon>);
 
         /**
-         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         * @return 実行環境がリトルエンディアンならtrue
          */
-        explicit operator bool() const noexcept {
-            return valid;
+        [[nodiscard]]
+        static inline bool is_little_endian() noexcept {
+            const std::uint16_t value = 1;
+            unsigned char byte;
+            std::memcpy(&byte, &value, 1);
+            return byte == 1;
         }
 
         /**
-         * @return ポリゴンが格納された配列の先頭へのイテレータ
+         * リトルエンディアンの32bit符号なし整数を読み取ります
+         * @param src 読み取り元
+         * @return 読み取った値
          */
         [[nodiscard]]
-        const auto begin() const noexcept {
-            return polygons_.begin();
+        static inline std::uint32_t decode_u32(const char *src) noexcept {
+            unsigned char bytes[4];
+            std::memcpy(bytes, src, 4);
+            return static_cast<std::uint32_t>(bytes[0])
+                | static_cast<std::uint32_t>(bytes[1]) << 8
+                | static_cast<std::uint32_t>(bytes[2]) << 16
+                | static_cast<std::uint32_t>(bytes[3]) << 24;
         }
 
         /**
-         * @return ポリゴンが格納された配列の終端へのイテレータ
+         * リトルエンディアンの単精度浮動小数点数を読み取ります
+         * @param src 読み取り元
+         * @return 読み取った値
          */
         [[nodiscard]]
-        const auto end() const noexcept {
-            return polygons_.end();
+        static inline float decode_float(const char *src) noexcept {
+            const std::uint32_t bits = decode_u32(src);
+            float value;
+            std::memcpy(&value, &bits, 4);
+            return value;
         }
 
         /**
-         * @return STLファイルの先頭の文字列
-         * @details 読み取り専用
+         * リトルエンディアンの三次元ベクトルを読み取ります
+         * @param src 読み取り元
+         * @return 読み取った値
          */
         [[nodiscard]]
-        const auto &header() const noexcept {
-            return header_;
+        static inline STLVector decode_vector(const char *src) noexcept {
+            return { decode_float(src), decode_float(src + 4), decode_float(src + 8) };
         }
 
         /**
-         * @return ポリゴンの配列への参照
-         * @details 読み取り専用
+         * 50byteのレコードの列をポリゴンに変換します
+         * @param src レコードの列の先頭
+         * @param count レコードの数
+         * @param dst 書き込み先
+         * @details リトルエンディアン環境ではレコードの先頭48byteをそのままコピーします
          */
-        [[nodiscard]]
-        const auto &polygons() const noexcept {
-            return polygons_;
+        static inline void decode_polygons(const char *src, const std::size_t count, STLPolygon *dst) noexcept {
+            if (is_little_endian()) {
+                for (std::size_t i = 0; i < count; ++i) {
+                    std::memcpy(&dst[i], src + i * stl_record_size, sizeof(STLPolygon));
+                }
+                return;
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                const char *record = src + i * stl_record_size;
+                dst[i] = {
+                    decode_vector(record),
+                    decode_vector(record + 12),
+                    decode_vector(record + 24),
+                    decode_vector(record + 36)
+                };
+            }
         }
-    };
 
-    namespace internal {
+        /**
+         * 32bit符号なし整数をリトルエンディアンで書き込みます
+         * @param value 書き込む値
+         * @param dst 書き込み先
+         */
+        static inline void encode_u32(const std::uint32_t value, char *dst) noexcept {
+            const unsigned char bytes[4] = {
+                static_cast<unsigned char>(value),
+                static_cast<unsigned char>(value >> 8),
+                static_cast<unsigned char>(value >> 16),
+                static_cast<unsigned char>(value >> 24)
+            };
+            std::memcpy(dst, bytes, 4);
+        }
 
         /**
-         * 線分と ax + by + cz + d = 0 で表される平面の交点の媒介変数の値を求めます
-         * @param segment 線分
-         * @param a 平面の式のxの係数
-         * @param b 平面の式のyの係数
-         * @param c 平面の式のzの係数
-         * @param d 平面の式の定数
-         * @return 交点の媒介変数の値
+         * 三次元ベクトルをリトルエンディアンで書き込みます
+         * @param value 書き込む値
+         * @param dst 書き込み先
          */
-        [[nodiscard]]
-        static inline float segment_plane_intersection(
-            const STLSegment &segment,
-            const float a, const float b, const float c, const float d
-        ) noexcept {
-            const auto& [ x1, y1, z1 ] = segment.p;
-            const auto& [ x2, y2, z2 ] = segment.q;
-            return -(a * x1 + b * y1 + c * z1 + d)
-                / (a * (x2 - x1) + b * (y2 - y1) + c * (z2 - z1));
+        static inline void encode_vector(const STLVector &value, char *dst) noexcept {
+            const float components[3] = { value.x, value.y, value.z };
+            for (int i = 0; i < 3; ++i) {
+                std::uint32_t bits;
+                std::memcpy(&bits, &components[i], 4);
+                encode_u32(bits, dst + 4 * i);
+            }
         }
 
         /**
-         * 線分の内分点を求めます
-         * @param segment 線分
-         * @param t 内分比 1 - t : t
-         * @return 内分点
+         * ポリゴンを50byteのレコードの列に変換します
+         * @param src ポリゴンの配列の先頭
+         * @param count ポリゴンの数
+         * @param dst 書き込み先
+         * @details 属性の2byteは0にします．リトルエンディアン環境ではポリゴンをそのままコピーします
+         */
+        static inline void encode_polygons(const STLPolygon *src, const std::size_t count, char *dst) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                char *record = dst + i * stl_record_size;
+                if (is_little_endian()) {
+                    std::memcpy(record, &src[i], sizeof(STLPolygon));
+                } else {
+                    encode_vector(src[i].normal, record);
+                    encode_vector(src[i].a, record + 12);
+                    encode_vector(src[i].b, record + 24);
+                    encode_vector(src[i].c, record + 36);
+                }
+                record[48] = 0;
+                record[49] = 0;
+            }
+        }
+
+        /**
+         * ストリームからレコードをまとめて読み込んでポリゴンに変換します
+         * @param stream 読み込み元のストリーム
+         * @param dst 書き込み先
+         * @param count 読み込むポリゴンの数
+         * @param on_block 変換したブロックごとに (先頭, ポリゴンの数) を受け取り，続けるならtrueを返す関数
+         * @return 全てのレコードを読み込めたらtrue
+         */
+        template <class F>
+        bool read_polygons(std::istream &stream, STLPolygon *dst, std::size_t count, F &&on_block) {
+            std::vector<char> buffer(std::min(count, stl_block_records) * stl_record_size);
+            while (count > 0) {
+                const std::size_t n = std::min(count, stl_block_records);
+                if (!stream.read(buffer.data(), static_cast<std::streamsize>(n * stl_record_size))) {
+                    return false;
+                }
+                decode_polygons(buffer.data(), n, dst);
+                if (!on_block(dst, n)) {
+                    return false;
+                }
+                dst += n;
+                count -= n;
+            }
+            return true;
+        }
+
+        /**
+         * ストリームからレコードをまとめて読み込んでポリゴンに変換します
+         * @param stream 読み込み元のストリーム
+         * @param dst 書き込み先
+         * @param count 読み込むポリゴンの数
+         * @return 全てのレコードを読み込めたらtrue
+         */
+        static inline bool read_polygons(std::istream &stream, STLPolygon *dst, const std::size_t count) {
+            return read_polygons(stream, dst, count, [](STLPolygon *, std::size_t) { return true; });
+        }
+
+        /**
+         * 読み込んだポリゴンに対して，変換の直後に行う処理
+         * @details ブロックごとに変換した直後に適用するので，ポリゴンをもう一度メモリから読み直すことはありません
+         */
+        struct PolygonPostprocess {
+            bool normals = false; // 法線ベクトルを頂点から計算し直すかどうか
+            STLPolygonBounds *bounds = nullptr; // ポリゴンごとの包含箱の格納先．nullptrなら求めない
+
+            /**
+             * @return 行う処理があればtrue
+             */
+            [[nodiscard]]
+            bool enabled() const noexcept {
+                return normals || bounds != nullptr;
+            }
+
+            /**
+             * 変換したポリゴンの区間に処理を適用します
+             * @param polygons ポリゴンの配列の先頭
+             * @param begin 区間の先頭の番号
+             * @param end 区間の終端の番号
+             * @param box 区間のポリゴンの頂点で広げる直方体
+             */
+            void operator()(STLPolygon *polygons, const std::size_t begin, const std::size_t end, STLBoundingBox &box) const noexcept {
+                for (std::size_t i = begin; i < end; ++i) {
+                    auto &[ normal, a, b, c ] = polygons[i];
+                    if (normals) {
+                        const float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+                        const float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+                        const float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+                        const float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+                        // 縮退した三角形の法線ベクトルは0とする
+                        normal = length > 0 && std::isfinite(length)
+                            ? STLVector { nx / length, ny / length, nz / length }
+                            : STLVector { 0, 0, 0 };
+                    }
+                    if (bounds != nullptr) {
+                        const float lx = std::min({ a.x, b.x, c.x }), ly = std::min({ a.y, b.y, c.y }), lz = std::min({ a.z, b.z, c.z });
+                        const float hx = std::max({ a.x, b.x, c.x }), hy = std::max({ a.y, b.y, c.y }), hz = std::max({ a.z, b.z, c.z });
+                        bounds->min_x[i] = lx;
+                        bounds->min_y[i] = ly;
+                        bounds->min_z[i] = lz;
+                        bounds->max_x[i] = hx;
+                        bounds->max_y[i] = hy;
+                        bounds->max_z[i] = hz;
+                        box.min = { std::min(box.min.x, lx), std::min(box.min.y, ly), std::min(box.min.z, lz) };
+                        box.max = { std::max(box.max.x, hx), std::max(box.max.y, hy), std::max(box.max.z, hz) };
+                    }
+                }
+            }
+        };
+
+        /**
+         * 使用するスレッド数を決めます
+         * @param threads 指定されたスレッド数．0ならハードウェアの並列数
+         * @param n 処理する要素の数
+         * @param min_chunk 1スレッドあたりの最小の要素数
+         * @return 使用するスレッド数
          */
         [[nodiscard]]
-        static inline STLVector point_on_line(
-            const STLSegment &segment,
-            const float t
-        ) noexcept {
-            const auto& [ x1, y1, z1 ] = segment.p;
-            const auto& [ x2, y2, z2 ] = segment.q;
-            return {
-                (1 - t) * x1 + t * x2,
-                (1 - t) * y1 + t * y2,
-                (1 - t) * z1 + t * z2
-            };
+        static inline std::size_t thread_count(unsigned int threads, const std::size_t n, const std::size_t min_chunk) noexcept {
+            if (threads == 0) {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            const std::size_t max_chunks = std::max<std::size_t>(n / std::max<std::size_t>(min_chunk, 1), 1);
+            return std::min<std::size_t>(threads, max_chunks);
         }
-    }
 
-    /**
-     * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
-     * @param polygons スライスの対象となるポリゴンの配列
-     * @param a 平面の式のxの係数
-     * @param b 平面の式のyの係数
-     * @param c 平面の式のzの係数
-     * @param d 平面の式の定数
-     * @return スライスして得られた線分の配列
-     */
-    [[nodiscard]]
-    std::vector<STLSegment> slice_polygons_at(
-        const std::vector<STLPolygon> &polygons,
-        const float a, const float b, const float c, const float d
-    ) noexcept {
-        std::vector<STLSegment> res;
-        for (const auto& [ ignore, p, q, r ] : polygons) {
-            float s = internal::segment_plane_intersection({ p, q }, a, b, c, d);
-            float t = internal::segment_plane_intersection({ q, r }, a, b, c, d);
-            float u = internal::segment_plane_intersection({ r, p }, a, b, c, d);
-
-            if (0 <= s && s < 1 && 0 <= t && t < 1) {
-                STLVector alpha = internal::point_on_line({ p, q }, s);
-                STLVector beta  = internal::point_on_line({ q, r }, t);
-                res.push_back({ alpha, beta });
-            } else if (0 <= t && t < 1 && 0 <= u && u < 1) {
-                STLVector alpha = internal::point_on_line({ q, r }, t);
-                STLVector beta  = internal::point_on_line({ r, p }, u);
-                res.push_back({ alpha, beta });
-            } else if (0 <= u && u < 1 && 0 <= s && s < 1) {
-                STLVector alpha = internal::point_on_line({ r, p }, u);
-                STLVector beta  = internal::point_on_line({ p, q }, s);
-                res.push_back({ alpha, beta });
+        /**
+         * [0, n) を連続した区間に分割し，各区間について並列に関数を呼び出します
+         * @param n 処理する要素の数
+         * @param chunks 分割数
+         * @param f 区間の番号，始点，終点を受け取る関数
+         * @details 最初の区間は呼び出したスレッドで処理します． f やスレッドの作成が例外を送出した場合も，
+         * 起動済みのスレッドを全て合流させてから最初の例外を呼び出し側に送出します
+         */
+        template <class F>
+        void parallel_chunks(const std::size_t n, const std::size_t chunks, F &&f) {
+            std::vector<std::exception_ptr> errors(chunks); // 区間ごとに送出された例外
+            std::vector<std::thread> workers;
+            // スレッドの作成に失敗して抜ける場合も，合流させずに std::thread を破棄しないようにする
+            struct Joiner {
+                std::vector<std::thread> &workers; // 合流させるスレッド
+
+                ~Joiner() {
+                    for (auto &worker : workers) {
+                        if (worker.joinable()) {
+                            worker.join();
+                        }
+                    }
+                }
+            } joiner { workers };
+            workers.reserve(chunks - 1);
+            for (std::size_t i = 1; i < chunks; ++i) {
+                workers.emplace_back([&f, &errors, i, n, chunks] {
+                    try {
+                        f(i, n * i / chunks, n * (i + 1) / chunks);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            try {
+                f(std::size_t { 0 }, std::size_t { 0 }, n / chunks);
+            } catch (...) {
+                errors[0] = std::current_exception();
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            for (const auto &error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
             }
         }
-        return res;
-    }
 
-    /**
-     * ポリゴンをx軸に垂直な平面でスライスします
-     * @param polygons スライスの対象となるポリゴンの配列
-     * @param x スライスを行うx座標
-     * @return スライスして得られた線分の配列
-     */
-    [[nodiscard]]
-    std::vector<STLSegment> slice_polygons_at_x(
-        const std::vector<STLPolygon> &polygons,
-        const float x
-    ) noexcept {
-        return slice_polygons_at(polygons, 1, 0, 0, -x);
-    }
+        /**
+         * 読み取り専用でメモリにマップしたファイル
+         * @details mmapが使えない環境ではファイル全体をメモリに読み込みます
+         */
+        struct MappedFile {
+        private:
+            const char *data_ = nullptr; // ファイルの先頭
+            std::size_t size_ = 0; // ファイルの大きさ [byte]
+            bool open_ = false; // ファイルが開けたかどうか
+#ifndef STLUTIL_HAS_MMAP
+            std::vector<char> buffer_; // ファイルの内容
+#endif
 
-    /**
-     * ポリゴンをy軸に垂直な平面でスライスします
-     * @param polygons スライスの対象となるポリゴンの配列
-     * @param y スライスを行うy座標
-     * @return スライスして得られた線分の配列
-     */
-    [[nodiscard]]
-    std::vector<STLSegment> slice_polygons_at_y(
-        const std::vector<STLPolygon> &polygons,
-        const float y
-    ) noexcept {
-        return slice_polygons_at(polygons, 0, 1, 0, -y);
-    }
+            void close() noexcept {
+#ifdef STLUTIL_HAS_MMAP
+                if (data_ != nullptr) {
+                    ::munmap(const_cast<char *>(data_), size_);
+                }
+#else
+                buffer_.clear();
+#endif
+                data_ = nullptr;
+                size_ = 0;
+                open_ = false;
+            }
 
-    /**
-     * ポリゴンをz軸に垂直な平面でスライスします
-     * @param polygons スライスの対象となるポリゴンの配列
-     * @param z スライスを行うz座標
-     * @return スライスして得られた線分の配列
-     */
-    [[nodiscard]]
-    std::vector<STLSegment> slice_polygons_at_z(
-        const std::vector<STLPolygon> &polygons,
-        const float z
-    ) noexcept {
-        return slice_polygons_at(polygons, 0, 0, 1, -z);
+        public:
+            MappedFile() noexcept = default;
+            MappedFile(const MappedFile&) = delete;
+            MappedFile &operator=(const MappedFile&) = delete;
+
+            /**
+             * ファイルをメモリにマップします
+             * @param path マップするファイルへのパス
+             */
+            explicit MappedFile(const std::string &path) noexcept {
+#ifdef STLUTIL_HAS_MMAP
+                const int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return;
+                }
+                struct stat st;
+                if (::fstat(fd, &st) != 0) {
+                    ::close(fd);
+                    return;
+                }
+                size_ = static_cast<std::size_t>(st.st_size);
+                if (size_ > 0) {
+                    void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr == MAP_FAILED) {
+                        ::close(fd);
+                        size_ = 0;
+                        return;
+                    }
+                    data_ = static_cast<const char *>(addr);
+                }
+                ::close(fd);
+                open_ = true;
+#else
+                std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+                if (!file) {
+                    return;
+                }
+                try {
+                    buffer_.resize(static_cast<std::size_t>(file.tellg()));
+                } catch (...) {
+                    return;
+                }
+                file.seekg(0);
+                if (!file.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()))) {
+                    buffer_.clear();
+                    return;
+                }
+                data_ = buffer_.data();
+                size_ = buffer_.size();
+                open_ = true;
+#endif
+            }
+
+            MappedFile(MappedFile &&other) noexcept {
+                *this = std::move(other);
+            }
+
+            MappedFile &operator=(MappedFile &&other) noexcept {
+                if (this != &other) {
+                    close();
+#ifndef STLUTIL_HAS_MMAP
+                    buffer_ = std::move(other.buffer_);
+#endif
+                    data_ = std::exchange(other.data_, nullptr);
+                    size_ = std::exchange(other.size_, 0);
+                    open_ = std::exchange(other.open_, false);
+                }
+                return *this;
+            }
+
+            ~MappedFile() {
+                close();
+            }
+
+            /**
+             * @return ファイルが開けていたらtrue
+             */
+            [[nodiscard]]
+            bool is_open() const noexcept {
+                return open_;
+            }
+
+            /**
+             * @return ファイルの先頭へのポインタ
+             */
+            [[nodiscard]]
+            const char *data() const noexcept {
+                return data_;
+            }
+
+            /**
+             * @return ファイルの大きさ [byte]
+             */
+            [[nodiscard]]
+            std::size_t size() const noexcept {
+                return size_;
+            }
+        };
+
+        /**
+         * ASCII形式のSTLを読み取る字句解析器
+         */
+        struct ASCIIParser {
+        private:
+            const char *cur_; // 現在の位置
+            const char *end_; // 終端
+
+        public:
+            ASCIIParser(const char *begin, const char *end) noexcept : cur_(begin), end_(end) {}
+
+            /**
+             * @return 現在の位置 (先頭からのバイト数の計算用)
+             */
+            [[nodiscard]]
+            const char *position() const noexcept {
+                return cur_;
+            }
+
+            /**
+             * 空白を読み飛ばします
+             */
+            void skip_space() noexcept {
+                while (cur_ != end_ && (*cur_ == ' ' || *cur_ == '\t' || *cur_ == '\n' || *cur_ == '\r' || *cur_ == '\f' || *cur_ == '\v')) {
+                    ++cur_;
+                }
+            }
+
+            /**
+             * 行末まで読み飛ばします
+             * @return 読み飛ばした文字列
+             */
+            std::string_view skip_line() noexcept {
+                const char *begin = cur_;
+                while (cur_ != end_ && *cur_ != '\n') {
+                    ++cur_;
+                }
+                return { begin, static_cast<std::size_t>(cur_ - begin) };
+            }
+
+            /**
+             * 空白で区切られた次の単語を読み取ります
+             * @return 読み取った単語．終端に達していたら空
+             */
+            std::string_view token() noexcept {
+                skip_space();
+                const char *begin = cur_;
+                while (cur_ != end_ && *cur_ != ' ' && *cur_ != '\t' && *cur_ != '\n' && *cur_ != '\r' && *cur_ != '\f' && *cur_ != '\v') {
+                    ++cur_;
+                }
+                return { begin, static_cast<std::size_t>(cur_ - begin) };
+            }
+
+            /**
+             * 次の単語が keyword であることを確認します
+             * @param keyword 期待する単語
+             * @return 一致すればtrue
+             */
+            bool expect(const std::string_view keyword) noexcept {
+                const std::string_view t = token();
+                if (t.size() != keyword.size()) {
+                    return false;
+                }
+                for (std::size_t i = 0; i < t.size(); ++i) {
+                    if ((t[i] | 0x20) != keyword[i]) { // 大文字と小文字を区別しない
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /**
+             * 次の単語を浮動小数点数として読み取ります
+             * @param value 読み取った値の格納先
+             * @return 読み取れたらtrue
+             */
+            bool number(float &value) noexcept {
+                std::string_view t = token();
+                if (!t.empty() && t.front() == '+') {
+                    t.remove_prefix(1);
+                }
+                if (t.empty()) {
+                    return false;
+                }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+                const auto [ ptr, ec ] = std::from_chars(t.data(), t.data() + t.size(), value);
+                return ec == std::errc() && ptr == t.data() + t.size();
+#else
+                char buffer[64];
+                if (t.size() >= sizeof(buffer)) {
+                    return false;
+                }
+                std::memcpy(buffer, t.data(), t.size());
+                buffer[t.size()] = '\0';
+                char *parsed;
+                value = std::strtof(buffer, &parsed);
+                return parsed == buffer + t.size();
+#endif
+            }
+
+            /**
+             * 次の単語が keyword で，その後に3つの浮動小数点数が続くことを確認して読み取ります
+             * @param keyword 期待する単語
+             * @param v 読み取った値の格納先
+             * @return 読み取れたらtrue
+             */
+            bool vector(const std::string_view keyword, STLVector &v) noexcept {
+                return expect(keyword) && number(v.x) && number(v.y) && number(v.z);
+            }
+        };
+
+        /**
+         * ASCII形式のSTLのポリゴンを読み取ります
+         * @param begin ファイルの先頭
+         * @param end ファイルの終端
+         * @param header 先頭行の格納先
+         * @param polygons ポリゴンの追加先
+         * @return 読み取りに失敗した位置．成功したら nullptr
+         */
+        template <class Polygons>
+        const char *parse_ascii(const char *begin, const char *end, std::string &header, Polygons &polygons) {
+            ASCIIParser parser(begin, end);
+            parser.skip_space();
+            const char *line = parser.position();
+            if (!parser.expect("solid")) {
+                return line;
+            }
+            parser.skip_line();
+            header.assign(line, std::min<std::size_t>(static_cast<std::size_t>(parser.position() - line), stl_header_size));
+            while (!header.empty() && (header.back() == '\r' || header.back() == '\n')) {
+                header.pop_back();
+            }
+            polygons.reserve(polygons.size() + static_cast<std::size_t>(end - begin) / 256);
+            for (;;) {
+                const char *at = parser.position();
+                const std::string_view t = parser.token();
+                if (t.empty()) {
+                    return nullptr;
+                }
+                const auto is = [&t](const std::string_view keyword) {
+                    return ASCIIParser(t.data(), t.data() + t.size()).expect(keyword);
+                };
+                if (is("endsolid") || is("solid")) {
+                    parser.skip_line(); // 名前を読み飛ばす．複数の solid を含むファイルにも対応する
+                    continue;
+                }
+                if (!is("facet")) {
+                    return at;
+                }
+                STLPolygon polygon;
+                if (!parser.vector("normal", polygon.normal)
+                    || !parser.expect("outer") || !parser.expect("loop")
+                    || !parser.vector("vertex", polygon.a)
+                    || !parser.vector("vertex", polygon.b)
+                    || !parser.vector("vertex", polygon.c)
+                    || !parser.expect("endloop") || !parser.expect("endfacet")) {
+                    return at;
+                }
+                polygons.push_back(polygon);
+            }
+        }
+
+        /**
+         * ファイルの先頭と大きさからASCII形式かどうかを判定します
+         * @param begin ファイルの先頭 (84byte以上あればその分だけ参照します)
+         * @param size ファイルの大きさ [byte]
+         * @return ASCII形式ならtrue
+         * @details 先頭が solid で始まっていても，大きさがバイナリ形式のポリゴン数と一致する場合はバイナリ形式とみなします
+         */
+        [[nodiscard]]
+        static inline bool looks_like_ascii(const char *begin, const std::size_t size) noexcept {
+            ASCIIParser parser(begin, begin + std::min<std::size_t>(size, stl_header_size));
+            if (!parser.expect("solid")) {
+                return false;
+            }
+            constexpr std::size_t body_offset = stl_header_size + stl_count_size;
+            if (size < body_offset) {
+                return true;
+            }
+            const std::uint64_t count = decode_u32(begin + stl_header_size);
+            return body_offset + count * stl_record_size != size;
+        }
+    }
+
+    /**
+     * STLファイルの形式
+     */
+    enum class STLFormat {
+        automatic, // ファイルの内容から判定する
+        binary, // バイナリ形式
+        ascii // ASCII形式
+    };
+
+    /**
+     * STLファイルの読み込みに失敗した理由
+     */
+    enum class STLErrorCode {
+        none, // 失敗していない
+        open_failed, // ファイルを開けない
+        too_small, // ヘッダを含むほどの大きさが無い
+        truncated, // ヘッダのポリゴンの数に対してファイルが小さい
+        invalid_ascii, // ASCII形式の構文が正しくない
+        read_failed, // 読み込みの途中でエラーが起きた
+        out_of_memory, // メモリを確保できない
+        cancelled // 読み込みが中断された
+    };
+
+    /**
+     * STLファイルの読み込み方法の設定
+     */
+    struct STLReadOptions {
+        unsigned int threads = 1; // ポリゴンの変換に使うスレッド数．0ならハードウェアの並列数，1ならストリームから順に読み込む
+        STLFormat format = STLFormat::automatic; // ファイルの形式
+        bool log_errors = true; // 失敗した理由を標準エラー出力にも書き出すかどうか
+        bool compute_bounds = false; // ポリゴンごとの包含箱とメッシュ全体の包含箱を求めるかどうか
+        bool recompute_normals = false; // 法線ベクトルをファイルの値ではなく頂点から求めるかどうか
+        const std::atomic<bool> *cancel = nullptr; // true になったら読み込みを中断するフラグ．ブロックを変換するたびに確認する
+    };
+
+    namespace internal {
+
+        /**
+         * STLファイルを読み込んでポリゴンの配列に格納する処理
+         * @tparam Polygons ポリゴンの格納先の型．std::vector<STLPolygon, Alloc> など
+         */
+        template <class Polygons>
+        struct STLLoader {
+            const char *name; // エラーの出力に使う関数名
+            std::string &header; // STLファイルの先頭80byteの格納先
+            Polygons &polygons; // ポリゴンの格納先
+            bool log_errors; // 失敗した理由を標準エラー出力にも書き出すかどうか
+
+            STLPolygonBounds *bounds = nullptr; // ポリゴンごとの包含箱の格納先．nullptrなら compute_bounds を無視する
+            PolygonPostprocess postprocess; // 変換の直後に行う処理
+            const std::atomic<bool> *cancel = nullptr; // 読み込みを中断するフラグ
+
+            STLFormat format = STLFormat::binary; // 読み込んだファイルの形式
+            STLErrorCode error = STLErrorCode::none; // 失敗した理由
+            std::string message; // 失敗した理由の説明
+
+            /**
+             * @param caller エラーの出力に使う関数名
+             * @param header_out STLファイルの先頭80byteの格納先
+             * @param polygons_out ポリゴンの格納先
+             * @param log 失敗した理由を標準エラー出力にも書き出すかどうか
+             */
+            STLLoader(const char *caller, std::string &header_out, Polygons &polygons_out, const bool log) noexcept
+                : name(caller), header(header_out), polygons(polygons_out), log_errors(log) {}
+
+            /**
+             * 失敗した理由を記録します
+             * @param code 失敗した理由
+             * @param text 失敗した理由の説明
+             */
+            void fail(const STLErrorCode code, std::string text) noexcept {
+                error = code;
+                message = std::move(text);
+                header.clear();
+                polygons.clear();
+                polygons.shrink_to_fit();
+                if (bounds != nullptr) {
+                    bounds->clear();
+                }
+                if (log_errors) {
+                    std::cerr << name << " Error: " << message << std::endl;
+                }
+            }
+
+            /**
+             * 失敗した理由を，メモリを確保できなくても記録します
+             * @param code 失敗した理由
+             * @param prefix 説明のうちパスの前の部分
+             * @param path 読み込むSTLファイルへのパス
+             * @param suffix 説明のうちパスの後の部分
+             * @param detail 説明の末尾に加える文字列
+             * @details 例外の処理中に使います．説明の文字列を確保できない場合は message を空にし，標準エラー出力には確保せずに書き出します
+             */
+            void fail_nothrow(
+                const STLErrorCode code, const char *prefix, const std::string &path, const char *suffix, const char *detail = ""
+            ) noexcept {
+                std::string text;
+                try {
+                    text = std::string(prefix) + path + suffix + detail;
+                } catch (...) {
+                    text.clear();
+                }
+                const bool log = std::exchange(log_errors, false);
+                fail(code, std::move(text));
+                log_errors = log;
+                if (log_errors) {
+                    std::cerr << name << " Error: " << prefix << path << suffix << detail << std::endl;
+                }
+            }
+
+            /**
+             * @return 読み込みの中断が要求されていればtrue
+             */
+            [[nodiscard]]
+            bool cancelled() const noexcept {
+                return cancel != nullptr && cancel->load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 読み込みが中断されたことを記録します
+             * @param path 読み込むSTLファイルへのパス
+             * @return 常にfalse
+             */
+            bool fail_cancelled(const std::string &path) noexcept {
+                fail(STLErrorCode::cancelled, "Loading file `" + path + "` was cancelled.");
+                return false;
+            }
+
+            /**
+             * @return 頂点を1つも含まない直方体
+             */
+            [[nodiscard]]
+            static STLBoundingBox empty_box() noexcept {
+                constexpr float inf = std::numeric_limits<float>::infinity();
+                return { { inf, inf, inf }, { -inf, -inf, -inf } };
+            }
+
+            /**
+             * 包含箱の格納先をポリゴンの数に合わせて確保します
+             * @param n ポリゴンの数
+             */
+            void prepare_bounds(const std::size_t n) {
+                if (postprocess.bounds != nullptr) {
+                    postprocess.bounds->resize(n);
+                }
+            }
+
+            /**
+             * 区間ごとに求めた直方体をまとめてメッシュ全体の包含箱とします
+             * @param boxes 区間ごとの直方体
+             * @param count 区間の数
+             */
+            void finish_bounds(const STLBoundingBox *boxes, const std::size_t count) noexcept {
+                if (postprocess.bounds == nullptr) {
+                    return;
+                }
+                STLBoundingBox mesh = empty_box();
+                for (std::size_t k = 0; k < count; ++k) {
+                    mesh.min = { std::min(mesh.min.x, boxes[k].min.x), std::min(mesh.min.y, boxes[k].min.y), std::min(mesh.min.z, boxes[k].min.z) };
+                    mesh.max = { std::max(mesh.max.x, boxes[k].max.x), std::max(mesh.max.y, boxes[k].max.y), std::max(mesh.max.z, boxes[k].max.z) };
+                }
+                postprocess.bounds->mesh = mesh;
+            }
+
+            /**
+             * ファイルの先頭を読んで形式を判定します
+             * @param path 読み込むSTLファイルへのパス
+             * @return 判定した形式．ファイルが開けない場合はバイナリ形式
+             */
+            [[nodiscard]]
+            static STLFormat detect_format(const std::string &path) {
+                std::ifstream stlfile(path, std::ios::in | std::ios::binary | std::ios::ate);
+                if (!stlfile) {
+                    return STLFormat::binary;
+                }
+                const auto size = static_cast<std::size_t>(stlfile.tellg());
+                char head[stl_header_size + stl_count_size];
+                stlfile.seekg(0);
+                stlfile.read(head, static_cast<std::streamsize>(std::min(size, sizeof(head))));
+                return looks_like_ascii(head, size) ? STLFormat::ascii : STLFormat::binary;
+            }
+
+            /**
+             * ASCII形式のファイルを読み込みます
+             * @param path 読み込むSTLファイルへのパス
+             * @return 読み込めたらtrue
+             */
+            bool read_ascii(const std::string &path) {
+                STLUTIL_METRIC_STOPWATCH(stopwatch);
+                const MappedFile file(path);
+                if (!file.is_open()) {
+                    fail(STLErrorCode::open_failed, "Cannot open file `" + path + "`.");
+                    return false;
+                }
+                STLUTIL_METRIC_LAP(stopwatch, open_ns);
+                if (cancelled()) {
+                    return fail_cancelled(path);
+                }
+                polygons.clear();
+                const char *error_at = parse_ascii(file.data(), file.data() + file.size(), header, polygons);
+                if (error_at != nullptr) {
+                    fail(STLErrorCode::invalid_ascii,
+                        "Invalid ASCII STL `" + path + "` at byte " + std::to_string(error_at - file.data()) + ".");
+                    return false;
+                }
+                if (cancelled()) {
+                    return fail_cancelled(path);
+                }
+                format = STLFormat::ascii;
+                if (postprocess.enabled()) {
+                    prepare_bounds(polygons.size());
+                    STLBoundingBox box = empty_box();
+                    postprocess(polygons.data(), 0, polygons.size(), box);
+                    finish_bounds(&box, 1);
+                }
+                STLUTIL_METRIC_LAP(stopwatch, decode_ns);
+                STLUTIL_METRIC_ADD(bytes_read, file.size());
+                STLUTIL_METRIC_ADD(polygons_read, polygons.size());
+                return true;
+            }
+
+            /**
+             * ストリームからブロックごとに読み込みます
+             * @param path 読み込むSTLファイルへのパス
+             * @return 読み込めたらtrue
+             */
+            bool read_stream(const std::string &path) {
+                STLUTIL_METRIC_STOPWATCH(stopwatch);
+                std::ifstream stlfile(path, std::ios::in | std::ios::binary | std::ios::ate);
+                if (!stlfile) {
+                    fail(STLErrorCode::open_failed, "Cannot open file `" + path + "`.");
+                    return false;
+                }
+                const auto file_size = static_cast<std::uint64_t>(stlfile.tellg());
+                stlfile.seekg(0);
+                STLUTIL_METRIC_LAP(stopwatch, open_ns);
+
+                constexpr std::size_t body_offset = stl_header_size + stl_count_size;
+                header.resize(stl_header_size);
+                char count[stl_count_size];
+                if (file_size < body_offset
+                    || !stlfile.read(header.data(), stl_header_size) // 先頭80byteの読み取り
+                    || !stlfile.read(count, stl_count_size)) { // ポリゴンの数の読み取り
+                    fail(STLErrorCode::too_small, "File `" + path + "` is too small.");
+                    return false;
+                }
+                // ヘッダの値は信用できないので，確保する前にファイルの大きさと照合する
+                const std::size_t size = decode_u32(count);
+                if ((file_size - body_offset) / stl_record_size < size) {
+                    fail(STLErrorCode::truncated, "File `" + path + "` is truncated.");
+                    return false;
+                }
+                STLUTIL_METRIC_LAP(stopwatch, header_ns);
+                polygons.resize(size);
+                prepare_bounds(size);
+                STLBoundingBox box = empty_box();
+                STLPolygon *const first = polygons.data();
+                const auto on_block = [this, first, &box](STLPolygon *block, const std::size_t n) {
+                    const auto begin = static_cast<std::size_t>(block - first);
+                    postprocess(first, begin, begin + n, box);
+                    return !cancelled();
+                };
+                const bool read = postprocess.enabled() || cancel != nullptr
+                    ? internal::read_polygons(stlfile, polygons.data(), polygons.size(), on_block)
+                    : internal::read_polygons(stlfile, polygons.data(), polygons.size());
+                finish_bounds(&box, 1);
+                if (cancelled()) {
+                    return fail_cancelled(path);
+                }
+                if (!read) {
+                    fail(STLErrorCode::read_failed, "Cannot read file `" + path + "`.");
+                    return false;
+                }
+                STLUTIL_METRIC_LAP(stopwatch, decode_ns);
+                STLUTIL_METRIC_ADD(bytes_read, body_offset + size * stl_record_size);
+                STLUTIL_METRIC_ADD(polygons_read, size);
+                return true;
+            }
+
+            /**
+             * ファイルをメモリにマップし，ポリゴンの区間ごとに並列に変換します
+             * @param path 読み込むSTLファイルへのパス
+             * @param threads 使用するスレッド数．0ならハードウェアの並列数
+             * @return 読み込めたらtrue
+             */
+            bool read_mapped(const std::string &path, const unsigned int threads) {
+                STLUTIL_METRIC_STOPWATCH(stopwatch);
+                const MappedFile file(path);
+                if (!file.is_open()) {
+                    fail(STLErrorCode::open_failed, "Cannot open file `" + path + "`.");
+                    return false;
+                }
+                STLUTIL_METRIC_LAP(stopwatch, open_ns);
+                constexpr std::size_t body_offset = stl_header_size + stl_count_size;
+                if (file.size() < body_offset) {
+                    fail(STLErrorCode::too_small, "File `" + path + "` is too small.");
+                    return false;
+                }
+                const std::size_t size = decode_u32(file.data() + stl_header_size);
+                if ((file.size() - body_offset) / stl_record_size < size) {
+                    fail(STLErrorCode::truncated, "File `" + path + "` is truncated.");
+                    return false;
+                }
+                header.assign(file.data(), stl_header_size);
+                STLUTIL_METRIC_LAP(stopwatch, header_ns);
+                STLUTIL_METRIC_ADD(bytes_read, body_offset + size * stl_record_size);
+                STLUTIL_METRIC_ADD(polygons_read, size);
+                polygons.resize(size);
+                const char *body = file.data() + body_offset;
+                STLPolygon *dst = polygons.data();
+                const std::size_t chunks = thread_count(threads, size, parallel_min_polygons);
+                if (!postprocess.enabled() && cancel == nullptr) {
+                    parallel_chunks(size, chunks, [body, dst](std::size_t, const std::size_t begin, const std::size_t end) {
+                        decode_polygons(body + begin * stl_record_size, end - begin, dst + begin);
+                    });
+                    STLUTIL_METRIC_LAP(stopwatch, decode_ns);
+                    return true;
+                }
+                prepare_bounds(size);
+                std::vector<STLBoundingBox> boxes(chunks, empty_box());
+                parallel_chunks(size, chunks, [this, body, dst, &boxes](const std::size_t k, const std::size_t begin, const std::size_t end) {
+                    // ブロックごとに変換と処理を交互に行い，変換したポリゴンがキャッシュにあるうちに処理する
+                    // 隣の区間の包含箱とキャッシュラインを共有しないよう，手元の変数に集めてから最後に1度だけ書き込む
+                    STLBoundingBox box = empty_box();
+                    for (std::size_t i = begin; i < end && !cancelled(); i += stl_block_records) {
+                        const std::size_t n = std::min(end - i, stl_block_records);
+                        decode_polygons(body + i * stl_record_size, n, dst + i);
+                        postprocess(dst, i, i + n, box);
+                    }
+                    boxes[k] = box;
+                });
+                if (cancelled()) {
+                    return fail_cancelled(path);
+                }
+                finish_bounds(boxes.data(), boxes.size());
+                STLUTIL_METRIC_LAP(stopwatch, decode_ns);
+                return true;
+            }
+
+            /**
+             * 設定に従ってSTLファイルを読み込みます
+             * @param path 読み込むSTLファイルへのパス
+             * @param options 読み込み方法の設定
+             * @return 読み込めたらtrue．失敗しても例外は送出しません
+             */
+            bool load(const std::string &path, const STLReadOptions &options) noexcept {
+                try {
+                    postprocess.normals = options.recompute_normals;
+                    postprocess.bounds = options.compute_bounds ? bounds : nullptr;
+                    cancel = options.cancel;
+                    if (bounds != nullptr) {
+                        bounds->clear();
+                    }
+                    // 実行を待つ間に中断された場合は，ファイルを開く前に終える
+                    if (cancelled()) {
+                        return fail_cancelled(path);
+                    }
+                    const STLFormat detected = options.format == STLFormat::automatic ? detect_format(path) : options.format;
+                    if (detected == STLFormat::ascii) {
+                        return read_ascii(path);
+                    } else if (options.threads == 1) {
+                        return read_stream(path);
+                    } else {
+                        return read_mapped(path, options.threads);
+                    }
+                } catch (const std::bad_alloc &) {
+                    // 説明の文字列を作る前に確保済みの領域を解放する
+                    polygons.clear();
+                    polygons.shrink_to_fit();
+                    fail_nothrow(STLErrorCode::out_of_memory, "Cannot allocate memory for file `", path, "`.");
+                } catch (const std::exception &e) {
+                    fail_nothrow(STLErrorCode::read_failed, "Cannot read file `", path, "`: ", e.what());
+                } catch (...) {
+                    fail_nothrow(STLErrorCode::read_failed, "Cannot read file `", path, "`.");
+                }
+                return false;
+            }
+        };
+    }
+
+    /**
+     * STLファイルのデータを保持する構造体
+     */
+    struct STLReader {
+    private:
+        std::string header_; // STLファイルの先頭80byte
+        std::vector<STLPolygon> polygons_; // ポリゴンの配列
+        STLPolygonBounds bounds_; // ポリゴンごとの包含箱．compute_bounds を指定した場合のみ
+
+        STLFormat format_ = STLFormat::binary; // 読み込んだファイルの形式
+
+        STLErrorCode error_ = STLErrorCode::none; // 失敗した理由
+        std::string message_; // 失敗した理由の説明
+
+        bool valid = false; // 読み取りが正常に行えたかどうか
+
+        /**
+         * 設定に従ってSTLファイルを読み込みます
+         * @param path 読み込むSTLファイルへのパス
+         * @param options 読み込み方法の設定
+         */
+        void load(const std::string &path, const STLReadOptions &options) noexcept {
+            internal::STLLoader<std::vector<STLPolygon>> loader { "STLReader::STLReader()", header_, polygons_, options.log_errors };
+            loader.bounds = &bounds_;
+            valid = loader.load(path, options);
+            format_ = loader.format;
+            error_ = loader.error;
+            message_ = std::move(loader.message);
+        }
+
+    public:
+        STLReader(const STLReader&) = delete;
+        STLReader &operator=(const STLReader&) = delete;
+
+        /**
+         * STLファイルを読み込んでポリゴンの読み出しを行ないます
+         * @param path 読み込むSTLファイルへのパス
+         */
+        explicit STLReader(const std::string &path) : STLReader(path, STLReadOptions {}) {}
+
+        /**
+         * 設定に従ってSTLファイルを読み込み，ポリゴンの読み出しを行ないます
+         * @param path 読み込むSTLファイルへのパス
+         * @param options 読み込み方法の設定
+         * @details threads が1以外の場合は，ヘッダから得たポリゴンの数だけ配列を確保してから，ファイルの区間ごとに並列に変換します．
+         * ASCII形式のファイルはメモリにマップして読み取ります．
+         * ポリゴンの数はファイルの大きさと照合してから配列を確保し，失敗しても例外は送出しません
+         */
+        STLReader(const std::string &path, const STLReadOptions &options) noexcept {
+            load(path, options);
+        }
+
+        /**
+         * 与えられた配列の領域を再利用してSTLファイルを読み込みます
+         * @param path 読み込むSTLファイルへのパス
+         * @param buffer ポリゴンの格納に使う配列．中身は消去されますが確保済みの領域は再利用されます
+         * @param options 読み込み方法の設定
+         */
+        STLReader(const std::string &path, std::vector<STLPolygon> &&buffer, const STLReadOptions &options = {}) noexcept
+            : polygons_(std::move(buffer)) {
+            polygons_.clear();
+            load(path, options);
+        }
+
+        /**
+         * 読み込んだデータを移動します
+         * @param other 移動元．移動後は読み取りに失敗した状態になります
+         */
+        STLReader(STLReader &&other) noexcept
+            : header_(std::move(other.header_)), polygons_(std::move(other.polygons_)), bounds_(std::move(other.bounds_)), format_(other.format_),
+              error_(other.error_), message_(std::move(other.message_)), valid(std::exchange(other.valid, false)) {
+            other.header_.clear();
+            other.polygons_.clear();
+            other.bounds_.clear();
+        }
+
+        /**
+         * 読み込んだデータを移動します
+         * @param other 移動元．移動後は読み取りに失敗した状態になります
+         * @return *this
+         */
+        STLReader &operator=(STLReader &&other) noexcept {
+            if (this != &other) {
+                header_ = std::move(other.header_);
+                polygons_ = std::move(other.polygons_);
+                bounds_ = std::move(other.bounds_);
+                format_ = other.format_;
+                error_ = other.error_;
+                message_ = std::move(other.message_);
+                valid = std::exchange(other.valid, false);
+                other.header_.clear();
+                other.polygons_.clear();
+                other.bounds_.clear();
+            }
+            return *this;
+        }
+
+        /**
+         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         */
+        explicit operator bool() const noexcept {
+            return valid;
+        }
+
+        /**
+         * @return 失敗した理由．成功していれば STLErrorCode::none
+         */
+        [[nodiscard]]
+        STLErrorCode error_code() const noexcept {
+            return error_;
+        }
+
+        /**
+         * @return 失敗した理由の説明．成功していれば空文字列
+         */
+        [[nodiscard]]
+        const std::string &error_message() const noexcept {
+            return message_;
+        }
+
+        /**
+         * @return ポリゴンが格納された配列の先頭へのイテレータ
+         */
+        [[nodiscard]]
+        const auto begin() const noexcept {
+            return polygons_.begin();
+        }
+
+        /**
+         * @return ポリゴンが格納された配列の終端へのイテレータ
+         */
+        [[nodiscard]]
+        const auto end() const noexcept {
+            return polygons_.end();
+        }
+
+        /**
+         * @return STLファイルの先頭の文字列．ASCII形式の場合は solid で始まる先頭行
+         * @details 読み取り専用
+         */
+        [[nodiscard]]
+        const auto &header() const noexcept {
+            return header_;
+        }
+
+        /**
+         * @return 読み込んだファイルの形式
+         */
+        [[nodiscard]]
+        STLFormat format() const noexcept {
+            return format_;
+        }
+
+        /**
+         * @return ポリゴンの配列への参照
+         * @details 読み取り専用
+         */
+        [[nodiscard]]
+        const auto &polygons() const noexcept {
+            return polygons_;
+        }
+
+        /**
+         * @return ポリゴンごとの包含箱への参照．STLReadOptions::compute_bounds を指定しなかった場合は空
+         * @details 読み取り専用．mesh には全てのポリゴンを囲む直方体が入っています
+         */
+        [[nodiscard]]
+        const STLPolygonBounds &polygon_bounds() const noexcept {
+            return bounds_;
+        }
+
+        /**
+         * ポリゴンの配列を複製せずに取り出します
+         * @return ポリゴンの配列．取り出した後の polygons() は空になりますが，polygon_bounds() はそのまま残ります
+         */
+        [[nodiscard]]
+        std::vector<STLPolygon> release_polygons() noexcept {
+            return std::exchange(polygons_, {});
+        }
+    };
+
+    /**
+     * STLファイルを読み込んで，与えられた配列にポリゴンを格納します
+     * @param path 読み込むSTLファイルへのパス
+     * @param polygons ポリゴンの格納先．std::pmr::vector<STLPolygon> などアロケータを指定した配列も使えます
+     * @param options 読み込み方法の設定
+     * @return 失敗した理由．成功したら STLErrorCode::none
+     * @details 読み込み方法は STLReader と同じです．失敗した場合 polygons は空になり，例外は送出しません．
+     * 包含箱の格納先が無いので STLReadOptions::compute_bounds は無視されます
+     */
+    template <class Alloc>
+    STLErrorCode load_polygons(
+        const std::string &path,
+        std::vector<STLPolygon, Alloc> &polygons,
+        const STLReadOptions &options = {}
+    ) noexcept {
+        std::string header;
+        internal::STLLoader<std::vector<STLPolygon, Alloc>> loader { "stlutil::load_polygons()", header, polygons, options.log_errors };
+        loader.load(path, options);
+        return loader.error;
+    }
+
+    /**
+     * 非同期の読み込みを中断するためのトークン
+     * @details 複製したトークンは同じフラグを共有します
+     */
+    struct STLCancelToken {
+    private:
+        std::shared_ptr<std::atomic<bool>> flag_ = std::make_shared<std::atomic<bool>>(false); // 中断が要求されたかどうか
+
+    public:
+        /**
+         * 読み込みの中断を要求します
+         * @details 読み込み中のスレッドは次のブロックを変換する前に中断し， STLErrorCode::cancelled で失敗します
+         */
+        void cancel() const noexcept {
+            flag_->store(true, std::memory_order_relaxed);
+        }
+
+        /**
+         * @return 中断が要求されていればtrue
+         */
+        [[nodiscard]]
+        bool cancelled() const noexcept {
+            return flag_->load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @return 中断のフラグ． STLReadOptions::cancel に渡せます
+         */
+        [[nodiscard]]
+        const std::atomic<bool> *flag() const noexcept {
+            return flag_.get();
+        }
+    };
+
+    namespace internal {
+        /**
+         * 非同期の読み込みを実行する固定数のスレッド
+         * @details 最初に使われたときにハードウェアの並列数だけスレッドを作り，プログラムの終了時に残りの処理を終えてから合流します
+         */
+        struct TaskPool {
+        private:
+            std::vector<std::thread> workers_; // 処理を実行するスレッド
+            std::deque<std::function<void()>> tasks_; // 実行を待つ処理
+            std::mutex mutex_; // tasks_ と stopping_ を守るロック
+            std::condition_variable ready_; // 処理の追加か終了を知らせる
+            bool stopping_ = false; // 終了が要求されたかどうか
+
+            /**
+             * 処理を取り出して実行し続けます
+             */
+            void run() {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                        if (tasks_.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                    }
+                    task();
+                }
+            }
+
+        public:
+            /**
+             * @param threads スレッド数
+             * @details 一部のスレッドしか作れなかった場合は作れた分だけで動作し，1つも作れなければ例外を送出します
+             */
+            explicit TaskPool(const unsigned int threads) {
+                workers_.reserve(threads);
+                for (unsigned int i = 0; i < threads; ++i) {
+                    try {
+                        workers_.emplace_back([this] { run(); });
+                    } catch (const std::system_error &) {
+                        if (workers_.empty()) {
+                            throw;
+                        }
+                        break;
+                    }
+                }
+            }
+
+            TaskPool(const TaskPool&) = delete;
+            TaskPool &operator=(const TaskPool&) = delete;
+
+            ~TaskPool() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping_ = true;
+                }
+                ready_.notify_all();
+                for (auto &worker : workers_) {
+                    worker.join();
+                }
+            }
+
+            /**
+             * 処理を追加します
+             * @param task 実行する処理
+             */
+            void submit(std::function<void()> task) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    tasks_.push_back(std::move(task));
+                }
+                ready_.notify_one();
+            }
+
+            /**
+             * @return プログラム全体で共有するスレッド
+             */
+            [[nodiscard]]
+            static TaskPool &instance() {
+                static TaskPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+                return pool;
+            }
+        };
+
+        /**
+         * 関数を共有のスレッドで実行し，結果を受け取る future を返します
+         * @param f 実行する関数
+         * @return f の戻り値を受け取る future
+         */
+        template <class F>
+        [[nodiscard]]
+        auto run_async(F &&f) -> std::future<std::invoke_result_t<std::decay_t<F>&>> {
+            using Result = std::invoke_result_t<std::decay_t<F>&>;
+            // std::function は複製できる関数しか保持できないので，packaged_task は共有ポインタ越しに呼び出す
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+            std::future<Result> result = task->get_future();
+            TaskPool::instance().submit([task] { (*task)(); });
+            return result;
+        }
+    }
+
+    /**
+     * STLファイルを共有のスレッドで読み込みます
+     * @param path 読み込むSTLファイルへのパス
+     * @param options 読み込み方法の設定． cancel は token のフラグで置き換えられます
+     * @param token 読み込みを中断するためのトークン
+     * @return 読み込んだ STLReader を受け取る future．失敗した場合も STLReader を返すので error_code() で理由を確認できます
+     * @details 複数のファイルを同時に読み込む場合に使います．ファイルの読み込みと変換はスレッドの上で行い， future を待つまで呼び出し側は止まりません
+     */
+    [[nodiscard]]
+    inline std::future<STLReader> load_stl_async(
+        const std::string &path,
+        const STLReadOptions &options = {},
+        const STLCancelToken &token = {}
+    ) {
+        return internal::run_async([path, options, token] {
+            STLReadOptions local = options;
+            local.cancel = token.flag();
+            return STLReader(path, local);
+        });
+    }
+
+    /**
+     * STLファイルを共有のスレッドで読み込み，続けて同じスレッドで関数を呼び出します
+     * @param path 読み込むSTLファイルへのパス
+     * @param then 読み込んだ STLReader を右辺値で受け取る関数．読み込みに失敗した場合も呼び出します
+     * @param options 読み込み方法の設定． cancel は token のフラグで置き換えられます
+     * @param token 読み込みを中断するためのトークン
+     * @return then の戻り値を受け取る future． then が送出した例外は future から再送出されます
+     * @details STLSliceIndex や STLBVH の構築まで呼び出し側を止めずに行う場合に使います．
+     * スレッドの数は固定なので， then の中で別の load_stl_async の future を待つと，待っている処理がスレッドを使い切って
+     * 永久に終わらないことがあります．複数のファイルを組み合わせる場合は，呼び出し側でそれぞれの future を待ってください
+     */
+    template <class F, std::enable_if_t<std::is_invocable_v<std::decay_t<F>&, STLReader&&>, int> = 0>
+    [[nodiscard]]
+    auto load_stl_async(
+        const std::string &path,
+        F &&then,
+        const STLReadOptions &options = {},
+        const STLCancelToken &token = {}
+    ) -> std::future<std::invoke_result_t<std::decay_t<F>&, STLReader&&>> {
+        return internal::run_async([path, then = std::forward<F>(then), options, token]() mutable {
+            STLReadOptions local = options;
+            local.cancel = token.flag();
+            return then(STLReader(path, local));
+        });
+    }
+
+    /**
+     * STLファイルの書き込み方法の設定
+     */
+    struct STLWriteOptions {
+        unsigned int threads = 1; // ポリゴンの変換に使うスレッド数．0ならハードウェアの並列数，1ならストリームに順に書き込む
+        bool log_errors = true; // 失敗した理由を標準エラー出力にも書き出すかどうか
+    };
+
+    namespace internal {
+
+        /**
+         * 書き込み用にメモリにマップしたファイル
+         * @details マップする前にファイルの領域を確保するので，書き込み中に容量が足りなくなって SIGBUS になることはありません．
+         * mmapか posix_fallocate が使えない環境では開けません
+         */
+        struct MappedOutput {
+        private:
+            char *data_ = nullptr; // ファイルの先頭
+            std::size_t size_ = 0; // ファイルの大きさ [byte]
+
+        public:
+            MappedOutput(const MappedOutput&) = delete;
+            MappedOutput &operator=(const MappedOutput&) = delete;
+
+            /**
+             * ファイルを作り直して指定した大きさの領域を確保し，メモリにマップします
+             * @param path 書き込むファイルへのパス
+             * @param size ファイルの大きさ [byte]
+             * @details 領域を確保できなかった場合 (容量や割り当ての不足など) は開けません
+             */
+            MappedOutput(const std::string &path, const std::size_t size) noexcept {
+#if defined(STLUTIL_HAS_MMAP) && !defined(__APPLE__)
+                const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    return;
+                }
+                // ftruncate だけでは疎なファイルになり，容量が足りない場合にマップへの書き込みが SIGBUS になる
+                if (::posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0) {
+                    void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (addr != MAP_FAILED) {
+                        data_ = static_cast<char *>(addr);
+                        size_ = size;
+                    }
+                }
+                ::close(fd);
+#else
+                // macOS には posix_fallocate が無い
+                (void)path;
+                (void)size;
+#endif
+            }
+
+            ~MappedOutput() {
+#ifdef STLUTIL_HAS_MMAP
+                if (data_ != nullptr) {
+                    ::munmap(data_, size_);
+                }
+#endif
+            }
+
+            /**
+             * @return マップできていればtrue
+             */
+            [[nodiscard]]
+            bool is_open() const noexcept {
+                return data_ != nullptr;
+            }
+
+            /**
+             * @return ファイルの先頭
+             */
+            [[nodiscard]]
+            char *data() const noexcept {
+                return data_;
+            }
+
+            /**
+             * 書き込んだ内容をファイルに書き出します
+             * @return 書き出せたらtrue
+             * @details マップへの書き込みは失敗を返さないので，ディスクへの書き出しを待って書き込みのエラーを確認します
+             */
+            bool flush() noexcept {
+#ifdef STLUTIL_HAS_MMAP
+                return ::msync(data_, size_, MS_SYNC) == 0;
+#else
+                return false;
+#endif
+            }
+        };
+
+        /**
+         * STLファイルの先頭84byte (ヘッダとポリゴンの数) を作ります
+         * @param header ヘッダの文字列．80byteに満たない部分は0で埋め，超えた部分は切り捨てます
+         * @param count ポリゴンの数
+         * @param dst 書き込み先
+         */
+        static inline void encode_stl_header(const std::string &header, const std::uint32_t count, char *dst) noexcept {
+            std::memset(dst, 0, stl_header_size);
+            std::memcpy(dst, header.data(), std::min(header.size(), stl_header_size));
+            encode_u32(count, dst + stl_header_size);
+        }
+    }
+
+    /**
+     * ポリゴンの配列をバイナリ形式のSTLファイルに書き込みます
+     * @param path 書き込むSTLファイルへのパス
+     * @param polygons 書き込むポリゴンの配列
+     * @param header ヘッダの文字列．80byteに満たない部分は0で埋め，超えた部分は切り捨てます
+     * @param options 書き込み方法の設定
+     * @return 書き込めたらtrue
+     * @details レコードはブロックごとにまとめて変換して書き込みます． threads が1以外なら出力の領域を確保してからメモリにマップし，区間ごとに並列に変換します．
+     * マップした場合はディスクへの書き出しを待ってから返るので，書き込みのエラーも false として返ります．
+     * 書き込んだファイルは STLReader でそのまま読み込めます
+     */
+    template <class Alloc>
+    bool write_stl(
+        const std::string &path,
+        const std::vector<STLPolygon, Alloc> &polygons,
+        const std::string &header = {},
+        const STLWriteOptions &options = {}
+    ) {
+        const auto fail = [&options, &path](const char *reason) {
+            if (options.log_errors) {
+                std::cerr << "stlutil::write_stl() Error: " << reason << " `" << path << "`." << std::endl;
+            }
+            return false;
+        };
+        if (polygons.size() > std::numeric_limits<std::uint32_t>::max()) {
+            return fail("Too many polygons for file");
+        }
+        constexpr std::size_t body_offset = internal::stl_header_size + internal::stl_count_size;
+        const std::size_t size = polygons.size();
+        const STLPolygon *src = polygons.data();
+
+        if (options.threads != 1) {
+            internal::MappedOutput file(path, body_offset + size * internal::stl_record_size);
+            if (file.is_open()) {
+                char *body = file.data() + body_offset;
+                internal::encode_stl_header(header, static_cast<std::uint32_t>(size), file.data());
+                const std::size_t chunks = internal::thread_count(options.threads, size, internal::parallel_min_polygons);
+                internal::parallel_chunks(size, chunks, [body, src](std::size_t, const std::size_t begin, const std::size_t end) {
+                    internal::encode_polygons(src + begin, end - begin, body + begin * internal::stl_record_size);
+                });
+                return file.flush() || fail("Cannot write file");
+            }
+            // マップできない環境や領域を確保できない場合はストリームに書き込む (容量が足りなければそこで失敗する)
+        }
+
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return fail("Cannot open file");
+        }
+        std::vector<char> buffer(std::max(body_offset, std::min(size, internal::stl_block_records) * internal::stl_record_size));
+        internal::encode_stl_header(header, static_cast<std::uint32_t>(size), buffer.data());
+        file.write(buffer.data(), static_cast<std::streamsize>(body_offset));
+        for (std::size_t i = 0; i < size; i += internal::stl_block_records) {
+            const std::size_t n = std::min(size - i, internal::stl_block_records);
+            internal::encode_polygons(src + i, n, buffer.data());
+            file.write(buffer.data(), static_cast<std::streamsize>(n * internal::stl_record_size));
+        }
+        if (!file.flush()) {
+            return fail("Cannot write file");
+        }
+        return true;
+    }
+
+    namespace internal {
+
+        constexpr char segments_magic[8] = { 'S', 'T', 'L', 'U', 'S', 'E', 'G', 'S' }; // 線分ファイルの識別子
+        constexpr std::uint32_t segments_version = 1; // 線分ファイルの形式のバージョン
+        constexpr std::uint32_t segments_endian = 0x01020304; // バイト順の確認用の値
+
+        /**
+         * 線分ファイルのヘッダ
+         * @details 値は書き込んだ環境のバイト順で格納されます
+         */
+        struct SegmentsHeader {
+            char magic[8]; // 識別子
+            std::uint32_t version; // 形式のバージョン
+            std::uint32_t endian; // バイト順の確認用の値
+            std::uint64_t count; // 線分の数
+        };
+
+        static_assert(sizeof(SegmentsHeader) == 24 && std::is_trivially_copyable_v<SegmentsHeader>);
+        static_assert(sizeof(STLSegment) == 24 && std::is_trivially_copyable_v<STLSegment>);
+    }
+
+    /**
+     * スライスで得た線分の配列をファイルに書き込みます
+     * @param path 書き込むファイルへのパス
+     * @param segments 書き込む線分の配列
+     * @param options 書き込み方法の設定．log_errors のみを使います
+     * @return 書き込めたらtrue
+     * @details 24byteのヘッダの後に線分の配列をそのまま書き込みます．値は書き込んだ環境のバイト順で格納するので，
+     * バイト順の異なる環境では read_segments で読み込めません
+     */
+    template <class Alloc>
+    bool write_segments(
+        const std::string &path,
+        const std::vector<STLSegment, Alloc> &segments,
+        const STLWriteOptions &options = {}
+    ) {
+        const auto fail = [&options, &path](const char *reason) {
+            if (options.log_errors) {
+                std::cerr << "stlutil::write_segments() Error: " << reason << " `" << path << "`." << std::endl;
+            }
+            return false;
+        };
+        internal::SegmentsHeader header {};
+        std::memcpy(header.magic, internal::segments_magic, sizeof(header.magic));
+        header.version = internal::segments_version;
+        header.endian = internal::segments_endian;
+        header.count = segments.size();
+
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return fail("Cannot open file");
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(segments.data()), static_cast<std::streamsize>(segments.size() * sizeof(STLSegment)));
+        if (!file.flush()) {
+            return fail("Cannot write file");
+        }
+        return true;
+    }
+
+    /**
+     * write_segments で書き込んだ線分の配列を読み込みます
+     * @param path 読み込むファイルへのパス
+     * @param segments 線分の格納先．失敗した場合は空になります
+     * @param options 読み込み方法の設定．log_errors のみを使います
+     * @return 読み込めたらtrue
+     */
+    template <class Alloc>
+    bool read_segments(
+        const std::string &path,
+        std::vector<STLSegment, Alloc> &segments,
+        const STLReadOptions &options = {}
+    ) {
+        const auto fail = [&options](const std::string &message) {
+            if (options.log_errors) {
+                std::cerr << "stlutil::read_segments() Error: " << message << std::endl;
+            }
+            return false;
+        };
+        segments.clear();
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!file) {
+            return fail("Cannot open file `" + path + "`.");
+        }
+        const auto file_size = static_cast<std::uint64_t>(file.tellg());
+        file.seekg(0);
+        internal::SegmentsHeader header {};
+        if (file_size < sizeof(header) || !file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+            return fail("File `" + path + "` is too small.");
+        }
+        if (std::memcmp(header.magic, internal::segments_magic, sizeof(header.magic)) != 0
+            || header.version != internal::segments_version || header.endian != internal::segments_endian) {
+            return fail("File `" + path + "` is not a compatible segment file.");
+        }
+        // ヘッダの値は信用できないので，確保する前にファイルの大きさと照合する
+        if ((file_size - sizeof(header)) / sizeof(STLSegment) < header.count) {
+            return fail("File `" + path + "` is truncated.");
+        }
+        segments.resize(static_cast<std::size_t>(header.count));
+        if (!file.read(reinterpret_cast<char *>(segments.data()), static_cast<std::streamsize>(segments.size() * sizeof(STLSegment)))) {
+            segments.clear();
+            return fail("Cannot read file `" + path + "`.");
+        }
+        return true;
+    }
+
+    /**
+     * write_segments で書き込んだ線分の配列を読み込みます
+     * @param path 読み込むファイルへのパス
+     * @param options 読み込み方法の設定．log_errors のみを使います
+     * @return 線分の配列．失敗した場合は空です
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> read_segments(const std::string &path, const STLReadOptions &options = {}) {
+        std::vector<STLSegment> segments;
+        read_segments(path, segments, options);
+        return segments;
+    }
+
+    /**
+     * バイナリSTLのポリゴン1つ分のレコード (50byte) を表す構造体
+     * @details ファイル上のバイト列をそのまま参照するため，値はリトルエンディアンのまま格納されています
+     */
+    struct STLFacetRecord {
+        char bytes[internal::stl_record_size]; // レコードのバイト列
+
+        /**
+         * @return レコードを変換したポリゴン
+         */
+        [[nodiscard]]
+        STLPolygon polygon() const noexcept {
+            STLPolygon polygon;
+            internal::decode_polygons(bytes, 1, &polygon);
+            return polygon;
+        }
+
+        /**
+         * @return レコードの末尾2byteの属性値
+         */
+        [[nodiscard]]
+        std::uint16_t attribute() const noexcept {
+            const auto *p = reinterpret_cast<const unsigned char *>(bytes + 48);
+            return static_cast<std::uint16_t>(p[0] | p[1] << 8);
+        }
+    };
+
+    static_assert(sizeof(STLFacetRecord) == internal::stl_record_size && alignof(STLFacetRecord) == 1);
+
+    /**
+     * メモリにマップしたバイナリSTLファイルを読み取り専用で参照する構造体
+     * @details ポリゴンの配列をコピーせず，ファイル上のレコードを参照時に変換します
+     */
+    struct STLMappedView {
+    private:
+        internal::MappedFile file_; // マップしたファイル
+        std::string header_; // STLファイルの先頭80byte
+        const STLFacetRecord *records_ = nullptr; // レコードの配列の先頭
+        std::size_t size_ = 0; // ポリゴンの数
+
+        bool valid = false; // 読み取りが正常に行えたかどうか
+
+    public:
+        /**
+         * レコードを変換したポリゴンを順に返すイテレータ
+         * @details 参照先はイテレータが保持する変換済みのポリゴンなので，イテレータを進めた後は使わないでください
+         */
+        struct iterator {
+        private:
+            const STLFacetRecord *record_ = nullptr; // 現在のレコード
+            mutable STLPolygon polygon_ {}; // 変換済みのポリゴン
+
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = STLPolygon;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const STLPolygon *;
+            using reference = const STLPolygon &;
+
+            iterator() noexcept = default;
+
+            explicit iterator(const STLFacetRecord *record) noexcept : record_(record) {}
+
+            reference operator*() const noexcept {
+                polygon_ = record_->polygon();
+                return polygon_;
+            }
+
+            pointer operator->() const noexcept {
+                return &**this;
+            }
+
+            iterator &operator++() noexcept {
+                ++record_;
+                return *this;
+            }
+
+            iterator operator++(int) noexcept {
+                iterator tmp = *this;
+                ++record_;
+                return tmp;
+            }
+
+            friend bool operator==(const iterator &lhs, const iterator &rhs) noexcept {
+                return lhs.record_ == rhs.record_;
+            }
+
+            friend bool operator!=(const iterator &lhs, const iterator &rhs) noexcept {
+                return lhs.record_ != rhs.record_;
+            }
+        };
+
+        STLMappedView(const STLMappedView&) = delete;
+        STLMappedView &operator=(const STLMappedView&) = delete;
+
+        /**
+         * STLファイルをメモリにマップします
+         * @param path 読み込むSTLファイルへのパス
+         */
+        explicit STLMappedView(const std::string &path) : file_(path) {
+            if (!file_.is_open()) {
+                std::cerr << "STLMappedView::STLMappedView() Error: Cannot open file `" << path << "`." << std::endl;
+                return;
+            }
+            constexpr std::size_t body_offset = internal::stl_header_size + internal::stl_count_size;
+            if (file_.size() < body_offset) {
+                std::cerr << "STLMappedView::STLMappedView() Error: File `" << path << "` is too small." << std::endl;
+                return;
+            }
+            const std::size_t size = internal::decode_u32(file_.data() + internal::stl_header_size);
+            if ((file_.size() - body_offset) / internal::stl_record_size < size) {
+                std::cerr << "STLMappedView::STLMappedView() Error: File `" << path << "` is truncated." << std::endl;
+                return;
+            }
+            header_.assign(file_.data(), internal::stl_header_size);
+            records_ = reinterpret_cast<const STLFacetRecord *>(file_.data() + body_offset);
+            size_ = size;
+            valid = true;
+        }
+
+        STLMappedView(STLMappedView &&other) noexcept
+            : file_(std::move(other.file_)), header_(std::move(other.header_)),
+              records_(std::exchange(other.records_, nullptr)), size_(std::exchange(other.size_, 0)),
+              valid(std::exchange(other.valid, false)) {}
+
+        STLMappedView &operator=(STLMappedView &&other) noexcept {
+            file_ = std::move(other.file_);
+            header_ = std::move(other.header_);
+            records_ = std::exchange(other.records_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            valid = std::exchange(other.valid, false);
+            return *this;
+        }
+
+        /**
+         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         */
+        explicit operator bool() const noexcept {
+            return valid;
+        }
+
+        /**
+         * @return 先頭のポリゴンを指すイテレータ
+         */
+        [[nodiscard]]
+        iterator begin() const noexcept {
+            return iterator(records_);
+        }
+
+        /**
+         * @return 終端を指すイテレータ
+         */
+        [[nodiscard]]
+        iterator end() const noexcept {
+            return iterator(records_ + size_);
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return size_;
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return i番目のポリゴン
+         */
+        [[nodiscard]]
+        STLPolygon operator[](const std::size_t i) const noexcept {
+            return records_[i].polygon();
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return i番目のレコードへの参照
+         */
+        [[nodiscard]]
+        const STLFacetRecord &record(const std::size_t i) const noexcept {
+            return records_[i];
+        }
+
+        /**
+         * @return レコードの配列の先頭へのポインタ
+         */
+        [[nodiscard]]
+        const STLFacetRecord *records() const noexcept {
+            return records_;
+        }
+
+        /**
+         * @return STLファイルの先頭の文字列
+         * @details 読み取り専用
+         */
+        [[nodiscard]]
+        const auto &header() const noexcept {
+            return header_;
+        }
+    };
+
+    /**
+     * バイナリSTLファイルのポリゴンを一定数ずつ順に読み出す構造体
+     * @details ファイル全体のポリゴンを保持しないため，メモリに載らない大きさのファイルも扱えます
+     */
+    struct STLStreamReader {
+    private:
+        std::ifstream stlfile_; // 読み込み中のファイル
+        std::string header_; // STLファイルの先頭80byte
+        std::size_t size_ = 0; // ファイル全体のポリゴンの数
+        std::size_t remaining_ = 0; // まだ読み出していないポリゴンの数
+        std::size_t batch_size_; // 一度に読み出すポリゴンの最大数
+        std::vector<char> buffer_; // 読み込んだレコードの一時領域
+
+        bool valid = false; // 読み取りが正常に行えているかどうか
+
+    public:
+        STLStreamReader(const STLStreamReader&) = delete;
+
+        /**
+         * STLファイルを開いてヘッダの読み取りを行ないます
+         * @param path 読み込むSTLファイルへのパス
+         * @param batch_size 一度に読み出すポリゴンの最大数
+         */
+        explicit STLStreamReader(const std::string &path, const std::size_t batch_size = internal::stl_block_records)
+            : stlfile_(path, std::ios::in | std::ios::binary | std::ios::ate), batch_size_(std::max<std::size_t>(batch_size, 1)) {
+            if (!stlfile_) {
+                std::cerr << "STLStreamReader::STLStreamReader() Error: Cannot open file `" << path << "`." << std::endl;
+                return;
+            }
+            const auto file_size = static_cast<std::uint64_t>(stlfile_.tellg());
+            stlfile_.seekg(0);
+            header_.resize(internal::stl_header_size);
+            char count[internal::stl_count_size];
+            if (!stlfile_.read(header_.data(), internal::stl_header_size) || !stlfile_.read(count, internal::stl_count_size)) {
+                std::cerr << "STLStreamReader::STLStreamReader() Error: File `" << path << "` is too small." << std::endl;
+                return;
+            }
+            // ヘッダの値は信用できないので，ファイルの大きさと照合してから size() として公開する
+            const std::size_t size = internal::decode_u32(count);
+            constexpr std::size_t body_offset = internal::stl_header_size + internal::stl_count_size;
+            if ((file_size - body_offset) / internal::stl_record_size < size) {
+                std::cerr << "STLStreamReader::STLStreamReader() Error: File `" << path << "` is truncated." << std::endl;
+                return;
+            }
+            size_ = remaining_ = size;
+            valid = true;
+        }
+
+        /**
+         * 次のポリゴンの組を読み出します
+         * @param batch 読み出したポリゴンの格納先．大きさは batch_size 以下になります
+         * @return ポリゴンを読み出せたらtrue，終端に達したか読み取りに失敗したらfalse
+         */
+        bool next(std::vector<STLPolygon> &batch) {
+            batch.clear();
+            if (!valid || remaining_ == 0) {
+                return false;
+            }
+            const std::size_t n = std::min(remaining_, batch_size_);
+            buffer_.resize(n * internal::stl_record_size);
+            if (!stlfile_.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()))) {
+                std::cerr << "STLStreamReader::next() Error: File is truncated." << std::endl;
+                valid = false;
+                return false;
+            }
+            batch.resize(n);
+            internal::decode_polygons(buffer_.data(), n, batch.data());
+            remaining_ -= n;
+            return true;
+        }
+
+        /**
+         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         */
+        explicit operator bool() const noexcept {
+            return valid;
+        }
+
+        /**
+         * @return ファイル全体のポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return size_;
+        }
+
+        /**
+         * @return まだ読み出していないポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t remaining() const noexcept {
+            return remaining_;
+        }
+
+        /**
+         * @return STLファイルの先頭の文字列
+         * @details 読み取り専用
+         */
+        [[nodiscard]]
+        const auto &header() const noexcept {
+            return header_;
+        }
+    };
+
+    /**
+     * STLファイルのポリゴンを一定数ずつ読み出して関数に渡します
+     * @param path 読み込むSTLファイルへのパス
+     * @param f ポリゴンの配列を受け取る関数
+     * @param batch_size 一度に読み出すポリゴンの最大数
+     * @return ファイル全体を正常に読み取れたらtrue
+     */
+    template <class F>
+    bool for_each_polygon_batch(
+        const std::string &path,
+        F &&f,
+        const std::size_t batch_size = internal::stl_block_records
+    ) {
+        STLStreamReader reader(path, batch_size);
+        std::vector<STLPolygon> batch;
+        while (reader.next(batch)) {
+            f(static_cast<const std::vector<STLPolygon> &>(batch));
+        }
+        return static_cast<bool>(reader);
+    }
+
+    /**
+     * STLファイルのポリゴンを1つずつ関数に渡します
+     * @param path 読み込むSTLファイルへのパス
+     * @param f ポリゴンを受け取る関数
+     * @param batch_size 一度に読み出すポリゴンの最大数
+     * @return ファイル全体を正常に読み取れたらtrue
+     */
+    template <class F>
+    bool for_each_polygon(
+        const std::string &path,
+        F &&f,
+        const std::size_t batch_size = internal::stl_block_records
+    ) {
+        return for_each_polygon_batch(path, [&f](const std::vector<STLPolygon> &batch) {
+            for (const auto &polygon : batch) {
+                f(polygon);
+            }
+        }, batch_size);
+    }
+
+    /**
+     * STLファイルのポリゴンを別のスレッドで一定数ずつ読み出しながら関数に渡します
+     * @param path 読み込むSTLファイルへのパス
+     * @param f ポリゴンの配列を受け取る関数．呼び出したスレッドで実行されます
+     * @param batch_size 一度に読み出すポリゴンの最大数
+     * @return ファイル全体を正常に読み取れたらtrue
+     * @details 読み込みと変換は2つの配列を交互に使って別のスレッドで行うので，f の処理とファイルの読み込みが重なります．
+     * 保持するポリゴンは最大で 2 * batch_size 個です．読み出しのスレッドで送出された例外は，読み出し済みのポリゴンを f に渡した後に呼び出したスレッドで送出し直します
+     */
+    template <class F>
+    bool for_each_polygon_batch_pipelined(
+        const std::string &path,
+        F &&f,
+        const std::size_t batch_size = internal::stl_block_records
+    ) {
+        STLStreamReader reader(path, batch_size);
+        if (!reader) {
+            return false;
+        }
+        std::vector<STLPolygon> batches[2];
+        bool filled[2] = { false, false }; // 読み出したポリゴンが格納されているかどうか
+        bool finished = false; // 読み出しを終えたかどうか
+        bool stopped = false; // f が例外を送出して読み出しを止めるかどうか
+        std::exception_ptr error; // 読み出しのスレッドで送出された例外
+        std::mutex mutex;
+        std::condition_variable changed;
+
+        std::thread producer([&] {
+            for (std::size_t k = 0;; k ^= 1) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return !filled[k] || stopped; });
+                    if (stopped) {
+                        return;
+                    }
+                }
+                bool read = false;
+                try {
+                    read = reader.next(batches[k]);
+                } catch (...) {
+                    // 呼び出したスレッドで送出し直すので，ここでは読み出しを終えたものとして扱う
+                    error = std::current_exception();
+                }
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    (read ? filled[k] : finished) = true;
+                }
+                changed.notify_all();
+                if (!read) {
+                    return;
+                }
+            }
+        });
+
+        try {
+            for (std::size_t k = 0;; k ^= 1) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return filled[k] || finished; });
+                    if (!filled[k]) {
+                        break;
+                    }
+                }
+                f(static_cast<const std::vector<STLPolygon> &>(batches[k]));
+                {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    filled[k] = false;
+                }
+                changed.notify_all();
+            }
+        } catch (...) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                stopped = true;
+            }
+            changed.notify_all();
+            producer.join();
+            throw;
+        }
+        producer.join();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return static_cast<bool>(reader);
+    }
+
+    /**
+     * ポリゴンの頂点座標を成分ごとの配列で保持する構造体
+     * @details 頂点1, 2, 3 のそれぞれについて x, y, z 座標を別々の配列に格納します．法線ベクトルは必要な場合のみ保持します
+     */
+    struct STLMeshSoA {
+    private:
+        std::vector<float> x_[3]; // 頂点1, 2, 3 のx座標の配列
+        std::vector<float> y_[3]; // 頂点1, 2, 3 のy座標の配列
+        std::vector<float> z_[3]; // 頂点1, 2, 3 のz座標の配列
+        std::vector<float> nx_, ny_, nz_; // 法線ベクトルの成分の配列．保持しない場合は空
+        bool normals_; // 法線ベクトルを保持するかどうか
+
+        bool valid = true; // 読み取りが正常に行えたかどうか
+
+        /**
+         * 全ての配列を解放します
+         */
+        void release() noexcept {
+            for (int slot = 0; slot < 3; ++slot) {
+                x_[slot] = {};
+                y_[slot] = {};
+                z_[slot] = {};
+            }
+            nx_ = {};
+            ny_ = {};
+            nz_ = {};
+        }
+
+    public:
+        /**
+         * 空のメッシュを作成します
+         * @param keep_normals 法線ベクトルを保持するかどうか
+         */
+        explicit STLMeshSoA(const bool keep_normals = false) noexcept : normals_(keep_normals) {}
+
+        /**
+         * ポリゴンの配列から作成します
+         * @param polygons ポリゴンの配列
+         * @param keep_normals 法線ベクトルを保持するかどうか
+         */
+        explicit STLMeshSoA(const std::vector<STLPolygon> &polygons, const bool keep_normals = false)
+            : normals_(keep_normals) {
+            reserve(polygons.size());
+            for (const auto &polygon : polygons) {
+                push_back(polygon);
+            }
+        }
+
+        /**
+         * 読み込み済みのSTLファイルから作成します
+         * @param reader 読み込み済みのSTLファイル
+         * @param keep_normals 法線ベクトルを保持するかどうか
+         */
+        explicit STLMeshSoA(const STLReader &reader, const bool keep_normals = false)
+            : STLMeshSoA(reader.polygons(), keep_normals) {}
+
+        /**
+         * STLファイルから直接作成します
+         * @param path 読み込むSTLファイルへのパス
+         * @param keep_normals 法線ベクトルを保持するかどうか
+         * @details バイナリ形式はポリゴンの配列を経由せずに読み込みます．ASCII形式は STLReader で読み込んでから変換します．
+         * 失敗した場合は空になり，例外は送出しません
+         */
+        explicit STLMeshSoA(const std::string &path, const bool keep_normals = false) noexcept : normals_(keep_normals) {
+            valid = false;
+            try {
+                if (internal::STLLoader<std::vector<STLPolygon>>::detect_format(path) == STLFormat::ascii) {
+                    // ASCII形式はポリゴンの数がファイルの大きさから決まらないので，読み込み済みの配列から作る
+                    const STLReader reader(path);
+                    reserve(reader.polygons().size());
+                    for (const auto &polygon : reader.polygons()) {
+                        push_back(polygon);
+                    }
+                    valid = static_cast<bool>(reader);
+                    return;
+                }
+                // size() はファイルの大きさと照合済みなので，そのまま確保してよい
+                STLStreamReader reader(path);
+                reserve(reader.size());
+                std::vector<STLPolygon> batch;
+                while (reader.next(batch)) {
+                    for (const auto &polygon : batch) {
+                        push_back(polygon);
+                    }
+                }
+                valid = static_cast<bool>(reader);
+            } catch (const std::exception &e) {
+                release();
+                std::cerr << "STLMeshSoA::STLMeshSoA() Error: Cannot read file `" << path << "`: " << e.what() << std::endl;
+            }
+            if (!valid) {
+                release();
+            }
+        }
+
+        /**
+         * STLファイルから直接作成します
+         * @param path 読み込むSTLファイルへのパス
+         * @param keep_normals 法線ベクトルを保持するかどうか
+         * @details 文字列リテラルが bool を受け取るコンストラクタに変換されないようにするためのものです
+         */
+        explicit STLMeshSoA(const char *path, const bool keep_normals = false)
+            : STLMeshSoA(std::string(path), keep_normals) {}
+
+        /**
+         * @param n 確保するポリゴンの数
+         */
+        void reserve(const std::size_t n) {
+            for (int slot = 0; slot < 3; ++slot) {
+                x_[slot].reserve(n);
+                y_[slot].reserve(n);
+                z_[slot].reserve(n);
+            }
+            if (normals_) {
+                nx_.reserve(n);
+                ny_.reserve(n);
+                nz_.reserve(n);
+            }
+        }
+
+        /**
+         * ポリゴンを末尾に追加します
+         * @param polygon 追加するポリゴン
+         */
+        void push_back(const STLPolygon &polygon) {
+            const auto& [ normal, a, b, c ] = polygon;
+            const STLVector *vertices[3] = { &a, &b, &c };
+            for (int slot = 0; slot < 3; ++slot) {
+                x_[slot].push_back(vertices[slot]->x);
+                y_[slot].push_back(vertices[slot]->y);
+                z_[slot].push_back(vertices[slot]->z);
+            }
+            if (normals_) {
+                nx_.push_back(normal.x);
+                ny_.push_back(normal.y);
+                nz_.push_back(normal.z);
+            }
+        }
+
+        /**
+         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         */
+        explicit operator bool() const noexcept {
+            return valid;
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return x_[0].size();
+        }
+
+        /**
+         * @return 法線ベクトルを保持していればtrue
+         */
+        [[nodiscard]]
+        bool has_normals() const noexcept {
+            return normals_;
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return i番目のポリゴン．法線ベクトルを保持していない場合は法線ベクトルを0とします
+         */
+        [[nodiscard]]
+        STLPolygon polygon(const std::size_t i) const noexcept {
+            return {
+                normals_ ? STLVector { nx_[i], ny_[i], nz_[i] } : STLVector { 0, 0, 0 },
+                { x_[0][i], y_[0][i], z_[0][i] },
+                { x_[1][i], y_[1][i], z_[1][i] },
+                { x_[2][i], y_[2][i], z_[2][i] }
+            };
+        }
+
+        /**
+         * @param slot 頂点の番号 (0, 1, 2)
+         * @return 頂点のx座標の配列
+         */
+        [[nodiscard]]
+        const std::vector<float> &x(const std::size_t slot) const noexcept {
+            return x_[slot];
+        }
+
+        /**
+         * @param slot 頂点の番号 (0, 1, 2)
+         * @return 頂点のy座標の配列
+         */
+        [[nodiscard]]
+        const std::vector<float> &y(const std::size_t slot) const noexcept {
+            return y_[slot];
+        }
+
+        /**
+         * @param slot 頂点の番号 (0, 1, 2)
+         * @return 頂点のz座標の配列
+         */
+        [[nodiscard]]
+        const std::vector<float> &z(const std::size_t slot) const noexcept {
+            return z_[slot];
+        }
+
+        /**
+         * @return 法線ベクトルのx成分の配列．保持していない場合は空
+         */
+        [[nodiscard]]
+        const std::vector<float> &normal_x() const noexcept {
+            return nx_;
+        }
+
+        /**
+         * @return 法線ベクトルのy成分の配列．保持していない場合は空
+         */
+        [[nodiscard]]
+        const std::vector<float> &normal_y() const noexcept {
+            return ny_;
+        }
+
+        /**
+         * @return 法線ベクトルのz成分の配列．保持していない場合は空
+         */
+        [[nodiscard]]
+        const std::vector<float> &normal_z() const noexcept {
+            return nz_;
+        }
+    };
+
+    /**
+     * 座標軸
+     */
+    enum class STLAxis {
+        x, // x軸
+        y, // y軸
+        z  // z軸
+    };
+
+    namespace internal {
+
+        /**
+         * 線分の内分点を求めます
+         * @param segment 線分
+         * @param t 内分比 1 - t : t
+         * @return 内分点
+         */
+        [[nodiscard]]
+        static inline STLVector point_on_line(
+            const STLSegment &segment,
+            const float t
+        ) noexcept {
+            const auto& [ x1, y1, z1 ] = segment.p;
+            const auto& [ x2, y2, z2 ] = segment.q;
+            return {
+                (1 - t) * x1 + t * x2,
+                (1 - t) * y1 + t * y2,
+                (1 - t) * z1 + t * z2
+            };
+        }
+
+        /**
+         * 点と ax + by + cz + d = 0 で表される平面の符号付き距離 (の定数倍) を求めます
+         * @param v 点
+         * @param a 平面の式のxの係数
+         * @param b 平面の式のyの係数
+         * @param c 平面の式のzの係数
+         * @param d 平面の式の定数
+         * @return 平面の式の左辺の値
+         */
+        [[nodiscard]]
+        static inline float plane_distance(
+            const STLVector &v,
+            const float a, const float b, const float c, const float d
+        ) noexcept {
+            return a * v.x + b * v.y + c * v.z + d;
+        }
+
+        /**
+         * @param v ベクトル
+         * @return v の Axis 成分への参照
+         */
+        template <STLAxis Axis, class Vector>
+        [[nodiscard]]
+        static inline auto &axis_component(Vector &v) noexcept {
+            if constexpr (Axis == STLAxis::x) {
+                return v.x;
+            } else if constexpr (Axis == STLAxis::y) {
+                return v.y;
+            } else {
+                return v.z;
+            }
+        }
+
+        /**
+         * ax + by + cz + d = 0 で表される平面
+         */
+        struct GeneralPlane {
+            float a, b, c, d; // 平面の式の係数と定数
+
+            /**
+             * @param v 点
+             * @return 平面の式の左辺の値
+             */
+            [[nodiscard]]
+            float operator()(const STLVector &v) const noexcept {
+                return plane_distance(v, a, b, c, d);
+            }
+
+            /**
+             * 交点を補正します．一般の平面では何もしません
+             */
+            void snap(STLVector &) const noexcept {}
+        };
+
+        /**
+         * 座標軸に垂直な平面
+         * @details 平面の式の値は頂点の1成分と value の差だけで求まります．
+         * 有限の座標では GeneralPlane で係数を (0, 0, 1, -value) などとした場合と同じ値になります
+         */
+        template <STLAxis Axis>
+        struct AxisPlane {
+            float value; // 平面の Axis 座標
+
+            /**
+             * @param v 点
+             * @return 点の Axis 座標と value の差
+             */
+            [[nodiscard]]
+            float operator()(const STLVector &v) const noexcept {
+                return axis_component<Axis>(v) - value;
+            }
+
+            /**
+             * 交点の Axis 座標を平面の座標に揃えます
+             * @param v 交点
+             */
+            void snap(STLVector &v) const noexcept {
+                axis_component<Axis>(v) = value;
+            }
+        };
+
+        /**
+         * 3頂点の平面の式の値から，三角形が平面と交わり得るかを判定します
+         * @param dp 頂点1における平面の式の値
+         * @param dq 頂点2における平面の式の値
+         * @param dr 頂点3における平面の式の値
+         * @return 値が0以上の頂点と負の頂点の両方があればtrue
+         */
+        [[nodiscard]]
+        static inline bool may_cross_plane(const float dp, const float dq, const float dr) noexcept {
+            return !(dp >= 0 && dq >= 0 && dr >= 0) && !(dp < 0 && dq < 0 && dr < 0);
+        }
+
+        /**
+         * 各頂点における平面の式の値を使って三角形をスライスし，得られた線分を追加します
+         * @param p 三角形の頂点1
+         * @param q 三角形の頂点2
+         * @param r 三角形の頂点3
+         * @param dp 頂点1における平面の式の値
+         * @param dq 頂点2における平面の式の値
+         * @param dr 頂点3における平面の式の値
+         * @param plane 平面．GeneralPlane または AxisPlane
+         * @param res 線分の追加先．push_back で線分を受け取れるもの
+         * @details 値が0以上の頂点を平面の上側，負の頂点を下側として扱い，上側と下側にまたがる辺についてのみ交点を求めます．
+         * 平面上の頂点は上側に含めるので，隣接するポリゴンの間で交点が重複したり欠けたりしません．
+         * 交点は常に下側の頂点から上側の頂点に向かって求めるため，辺を共有するポリゴンでは同じ値になります．
+         * 線分は上側から下側へ向かう辺の交点を始点，下側から上側へ向かう辺の交点を終点とするので，
+         * 頂点の右ねじの向きが外向きなら，平面の上側から見て立体の断面を反時計回りに囲む向きになります．
+         * 交点は plane.snap で補正します．長さ0の線分と，頂点の座標が NaN の三角形は無視します
+         */
+        template <class Plane, class Out>
+        static inline void slice_triangle_at(
+            const STLVector &p, const STLVector &q, const STLVector &r,
+            const float dp, const float dq, const float dr,
+            const Plane &plane,
+            Out &res
+        ) {
+            if (std::isnan(dp) || std::isnan(dq) || std::isnan(dr)) {
+                return;
+            }
+            const STLVector *vertices[3] = { &p, &q, &r };
+            const float dist[3] = { dp, dq, dr };
+            STLSegment segment;
+            bool crossed = false;
+            for (int i = 0; i < 3; ++i) {
+                const int j = i == 2 ? 0 : i + 1;
+                const bool above = dist[i] >= 0;
+                if (above == (dist[j] >= 0)) {
+                    continue;
+                }
+                const int lo = above ? j : i; // 下側の頂点
+                const int hi = above ? i : j; // 上側の頂点
+                STLVector point = point_on_line(
+                    { *vertices[lo], *vertices[hi] },
+                    dist[lo] / (dist[lo] - dist[hi])
+                );
+                plane.snap(point);
+                (above ? segment.p : segment.q) = point;
+                crossed = true;
+            }
+            if (!crossed) {
+                return;
+            }
+            STLUTIL_METRIC_COUNT(crossing_triangles, 1);
+            const auto& [ alpha, beta ] = segment;
+            if (alpha.x == beta.x && alpha.y == beta.y && alpha.z == beta.z) {
+                STLUTIL_METRIC_COUNT(degenerate_segments, 1);
+                return;
+            }
+            // 座標軸に垂直な平面では平面の式に現れない成分の NaN をここで除く
+            if (std::isnan(alpha.x) || std::isnan(alpha.y) || std::isnan(alpha.z)
+                || std::isnan(beta.x) || std::isnan(beta.y) || std::isnan(beta.z)) {
+                STLUTIL_METRIC_COUNT(degenerate_segments, 1);
+                return;
+            }
+            res.push_back(segment);
+        }
+
+        /**
+         * 各頂点における平面の式の値を使って三角形をスライスし，得られた線分を追加します
+         * @param p 三角形の頂点1
+         * @param q 三角形の頂点2
+         * @param r 三角形の頂点3
+         * @param dp 頂点1における平面の式の値
+         * @param dq 頂点2における平面の式の値
+         * @param dr 頂点3における平面の式の値
+         * @param res 線分の追加先．push_back で線分を受け取れるもの
+         * @details 交点を補正しないことを除いて，平面を指定する版と同じです
+         */
+        template <class Out>
+        static inline void slice_triangle_at(
+            const STLVector &p, const STLVector &q, const STLVector &r,
+            const float dp, const float dq, const float dr,
+            Out &res
+        ) {
+            slice_triangle_at(p, q, r, dp, dq, dr, GeneralPlane {}, res);
+        }
+
+        /**
+         * 三角形を ax + by + cz + d = 0 で表される平面でスライスし，得られた線分を配列に追加します
+         * @param p 三角形の頂点1
+         * @param q 三角形の頂点2
+         * @param r 三角形の頂点3
+         * @param a 平面の式のxの係数
+         * @param b 平面の式のyの係数
+         * @param c 平面の式のzの係数
+         * @param d 平面の式の定数
+         * @param res 線分の追加先．push_back で線分を受け取れるもの
+         * @details 線分の求め方は slice_triangle_at を参照してください
+         */
+        template <class Out>
+        static inline void slice_triangle(
+            const STLVector &p, const STLVector &q, const STLVector &r,
+            const float a, const float b, const float c, const float d,
+            Out &res
+        ) {
+            const GeneralPlane plane { a, b, c, d };
+            STLUTIL_METRIC_COUNT(triangles_tested, 1);
+            slice_triangle_at(p, q, r, plane(p), plane(q), plane(r), plane, res);
+        }
+
+        /**
+         * 三角形を平面でスライスし，得られた線分を配列に追加します
+         * @param p 三角形の頂点1
+         * @param q 三角形の頂点2
+         * @param r 三角形の頂点3
+         * @param plane 平面．GeneralPlane または AxisPlane
+         * @param res 線分の追加先．push_back で線分を受け取れるもの
+         */
+        template <class Plane, class Out>
+        static inline void slice_triangle(
+            const STLVector &p, const STLVector &q, const STLVector &r,
+            const Plane &plane,
+            Out &res
+        ) {
+            STLUTIL_METRIC_COUNT(triangles_tested, 1);
+            slice_triangle_at(p, q, r, plane(p), plane(q), plane(r), plane, res);
+        }
+
+        /**
+         * 出力イテレータに線分を書き込むための push_back を提供します
+         */
+        template <class OutputIt>
+        struct OutputIteratorSink {
+            OutputIt it; // 書き込み先
+
+            void push_back(const STLSegment &segment) {
+                *it++ = segment;
+            }
+        };
+
+        /**
+         * ポリゴンの配列を平面でスライスします (スカラー版)
+         * @param polygons ポリゴンの配列の先頭
+         * @param n ポリゴンの数
+         * @param plane 平面．GeneralPlane または AxisPlane
+         * @param res 線分の追加先
+         */
+        template <class Plane, class Out>
+        static inline void slice_polygons_scalar(
+            const STLPolygon *polygons, const std::size_t n,
+            const Plane &plane,
+            Out &res
+        ) {
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto& [ ignore, p, q, r ] = polygons[i];
+                const float dp = plane(p);
+                const float dq = plane(q);
+                const float dr = plane(r);
+                if (may_cross_plane(dp, dq, dr)) {
+                    slice_triangle_at(p, q, r, dp, dq, dr, plane, res);
+                }
+            }
+        }
+
+        /**
+         * 成分ごとの配列で保持されたポリゴンを平面でスライスします (スカラー版)
+         * @param x 頂点1, 2, 3 のx座標の配列
+         * @param y 頂点1, 2, 3 のy座標の配列
+         * @param z 頂点1, 2, 3 のz座標の配列
+         * @param begin スライスを始めるポリゴンの番号
+         * @param end スライスを終えるポリゴンの番号
+         * @param plane 平面．GeneralPlane または AxisPlane
+         * @param res 線分の追加先
+         */
+        template <class Plane, class Out>
+        static inline void slice_mesh_scalar(
+            const float *const x[3], const float *const y[3], const float *const z[3],
+            const std::size_t begin, const std::size_t end,
+            const Plane &plane,
+            Out &res
+        ) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const STLVector p { x[0][i], y[0][i], z[0][i] };
+                const STLVector q { x[1][i], y[1][i], z[1][i] };
+                const STLVector r { x[2][i], y[2][i], z[2][i] };
+                const float dp = plane(p);
+                const float dq = plane(q);
+                const float dr = plane(r);
+                if (may_cross_plane(dp, dq, dr)) {
+                    slice_triangle_at(p, q, r, dp, dq, dr, plane, res);
+                }
+            }
+        }
+
+#ifdef STLUTIL_SIMD_AVX2
+        /**
+         * @return 実行環境がAVX2に対応していればtrue
+         */
+        [[nodiscard]]
+        static inline bool has_avx2() noexcept {
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+        }
+
+        /**
+         * 8つの三角形の頂点における平面の式の値から，平面と交わり得る三角形のビットマスクを求めます
+         */
+        __attribute__((target("avx2")))
+        static inline unsigned int may_cross_plane_avx2(const __m256 dp, const __m256 dq, const __m256 dr) noexcept {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 above = _mm256_and_ps(_mm256_and_ps(
+                _mm256_cmp_ps(dp, zero, _CMP_GE_OQ), _mm256_cmp_ps(dq, zero, _CMP_GE_OQ)), _mm256_cmp_ps(dr, zero, _CMP_GE_OQ));
+            const __m256 below = _mm256_and_ps(_mm256_and_ps(
+                _mm256_cmp_ps(dp, zero, _CMP_LT_OQ), _mm256_cmp_ps(dq, zero, _CMP_LT_OQ)), _mm256_cmp_ps(dr, zero, _CMP_LT_OQ));
+            return ~static_cast<unsigned int>(_mm256_movemask_ps(_mm256_or_ps(above, below))) & 0xffu;
+        }
+
+        /**
+         * 8つの点における平面の式の値を求めます
+         */
+        __attribute__((target("avx2")))
+        static inline __m256 plane_distance_avx2(
+            const __m256 x, const __m256 y, const __m256 z,
+            const __m256 a, const __m256 b, const __m256 c, const __m256 d
+        ) noexcept {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(a, x), _mm256_mul_ps(b, y)), _mm256_mul_ps(c, z)), d);
+        }
+
+        /**
+         * 8つの点における一般の平面の式の値を求めます
+         */
+        __attribute__((target("avx2")))
+        static inline __m256 plane_distance_avx2(
+            const __m256 x, const __m256 y, const __m256 z, const GeneralPlane &plane
+        ) noexcept {
+            return plane_distance_avx2(
+                x, y, z, _mm256_set1_ps(plane.a), _mm256_set1_ps(plane.b), _mm256_set1_ps(plane.c), _mm256_set1_ps(plane.d));
+        }
+
+        /**
+         * 8つの点における座標軸に垂直な平面の式の値を求めます
+         */
+        template <STLAxis Axis>
+        __attribute__((target("avx2")))
+        static inline __m256 plane_distance_avx2(
+            const __m256 x, const __m256 y, const __m256 z, const AxisPlane<Axis> &plane
+        ) noexcept {
+            const __m256 v = Axis == STLAxis::x ? x : Axis == STLAxis::y ? y : z;
+            return _mm256_sub_ps(v, _mm256_set1_ps(plane.value));
+        }
+
+        /**
+         * 2つの4要素の配列を下位と上位の128bitに読み込みます
+         */
+        __attribute__((target("avx2")))
+        static inline __m256 load_pair_avx2(const float *lo, const float *hi) noexcept {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+        }
+
+        /**
+         * ポリゴンの配列を平面でスライスします (AVX2版)
+         * @details 8つのポリゴンを読み込んで成分ごとに転置し，平面と交わり得るものだけを slice_triangle_at に渡します
+         */
+        template <class Plane, class Out>
+        __attribute__((target("avx2")))
+        static inline void slice_polygons_avx2(
+            const STLPolygon *polygons, const std::size_t n,
+            const Plane &plane,
+            Out &res
+        ) {
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                // ポリゴン i + k と i + k + 4 の12成分を4成分ずつ3つに分けて読み込む
+                __m256 v[3][4];
+                for (int k = 0; k < 4; ++k) {
+                    const float *lo = &polygons[i + k].normal.x;
+                    const float *hi = &polygons[i + k + 4].normal.x;
+                    for (int part = 0; part < 3; ++part) {
+                        v[part][k] = load_pair_avx2(lo + 4 * part, hi + 4 * part);
+                    }
+                }
+                // 128bitごとに4x4の転置を行ない，成分ごとのベクトルにする
+                __m256 t[3][4];
+                for (int part = 0; part < 3; ++part) {
+                    t[part][0] = _mm256_unpacklo_ps(v[part][0], v[part][1]);
+                    t[part][1] = _mm256_unpackhi_ps(v[part][0], v[part][1]);
+                    t[part][2] = _mm256_unpacklo_ps(v[part][2], v[part][3]);
+                    t[part][3] = _mm256_unpackhi_ps(v[part][2], v[part][3]);
+                }
+                const __m256 ax = _mm256_shuffle_ps(t[0][1], t[0][3], _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 ay = _mm256_shuffle_ps(t[1][0], t[1][2], _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 az = _mm256_shuffle_ps(t[1][0], t[1][2], _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 bx = _mm256_shuffle_ps(t[1][1], t[1][3], _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 by = _mm256_shuffle_ps(t[1][1], t[1][3], _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 bz = _mm256_shuffle_ps(t[2][0], t[2][2], _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 cx = _mm256_shuffle_ps(t[2][0], t[2][2], _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 cy = _mm256_shuffle_ps(t[2][1], t[2][3], _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 cz = _mm256_shuffle_ps(t[2][1], t[2][3], _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 dp = plane_distance_avx2(ax, ay, az, plane);
+                const __m256 dq = plane_distance_avx2(bx, by, bz, plane);
+                const __m256 dr = plane_distance_avx2(cx, cy, cz, plane);
+                unsigned int mask = may_cross_plane_avx2(dp, dq, dr);
+                if (mask == 0) {
+                    continue;
+                }
+                alignas(32) float dist[3][8];
+                _mm256_store_ps(dist[0], dp);
+                _mm256_store_ps(dist[1], dq);
+                _mm256_store_ps(dist[2], dr);
+                // slice_triangle_at はSSEの命令のまま呼ばれることがあるので，上位128bitを消去して切り替えの遅延を避ける
+                _mm256_zeroupper();
+                for (; mask != 0; mask &= mask - 1) {
+                    const auto k = static_cast<std::size_t>(__builtin_ctz(mask));
+                    const auto& [ ignore, p, q, r ] = polygons[i + k];
+                    slice_triangle_at(p, q, r, dist[0][k], dist[1][k], dist[2][k], plane, res);
+                }
+            }
+            _mm256_zeroupper();
+            slice_polygons_scalar(polygons + i, n - i, plane, res);
+        }
+
+        /**
+         * 成分ごとの配列で保持されたポリゴンを平面でスライスします (AVX2版)
+         */
+        template <class Plane, class Out>
+        __attribute__((target("avx2")))
+        static inline void slice_mesh_avx2(
+            const float *const x[3], const float *const y[3], const float *const z[3],
+            const std::size_t begin, const std::size_t end,
+            const Plane &plane,
+            Out &res
+        ) {
+            std::size_t i = begin;
+            for (; i + 8 <= end; i += 8) {
+                const __m256 dp = plane_distance_avx2(
+                    _mm256_loadu_ps(x[0] + i), _mm256_loadu_ps(y[0] + i), _mm256_loadu_ps(z[0] + i), plane);
+                const __m256 dq = plane_distance_avx2(
+                    _mm256_loadu_ps(x[1] + i), _mm256_loadu_ps(y[1] + i), _mm256_loadu_ps(z[1] + i), plane);
+                const __m256 dr = plane_distance_avx2(
+                    _mm256_loadu_ps(x[2] + i), _mm256_loadu_ps(y[2] + i), _mm256_loadu_ps(z[2] + i), plane);
+                unsigned int mask = may_cross_plane_avx2(dp, dq, dr);
+                if (mask == 0) {
+                    continue;
+                }
+                alignas(32) float dist[3][8];
+                _mm256_store_ps(dist[0], dp);
+                _mm256_store_ps(dist[1], dq);
+                _mm256_store_ps(dist[2], dr);
+                // slice_triangle_at はSSEの命令のまま呼ばれることがあるので，上位128bitを消去して切り替えの遅延を避ける
+                _mm256_zeroupper();
+                for (; mask != 0; mask &= mask - 1) {
+                    const auto k = static_cast<std::size_t>(__builtin_ctz(mask));
+                    const std::size_t j = i + k;
+                    slice_triangle_at(
+                        { x[0][j], y[0][j], z[0][j] },
+                        { x[1][j], y[1][j], z[1][j] },
+                        { x[2][j], y[2][j], z[2][j] },
+                        dist[0][k], dist[1][k], dist[2][k], plane, res
+                    );
+                }
+            }
+            _mm256_zeroupper();
+            slice_mesh_scalar(x, y, z, i, end, plane, res);
+        }
+#endif
+
+#ifdef STLUTIL_SIMD_NEON
+        /**
+         * 4つの点における平面の式の値を求めます
+         */
+        static inline float32x4_t plane_distance_neon(
+            const float32x4_t x, const float32x4_t y, const float32x4_t z,
+            const float32x4_t a, const float32x4_t b, const float32x4_t c, const float32x4_t d
+        ) noexcept {
+            return vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(a, x), vmulq_f32(b, y)), vmulq_f32(c, z)), d);
+        }
+
+        /**
+         * 4つの点における一般の平面の式の値を求めます
+         */
+        static inline float32x4_t plane_distance_neon(
+            const float32x4_t x, const float32x4_t y, const float32x4_t z, const GeneralPlane &plane
+        ) noexcept {
+            return plane_distance_neon(
+                x, y, z, vdupq_n_f32(plane.a), vdupq_n_f32(plane.b), vdupq_n_f32(plane.c), vdupq_n_f32(plane.d));
+        }
+
+        /**
+         * 4つの点における座標軸に垂直な平面の式の値を求めます
+         */
+        template <STLAxis Axis>
+        static inline float32x4_t plane_distance_neon(
+            const float32x4_t x, const float32x4_t y, const float32x4_t z, const AxisPlane<Axis> &plane
+        ) noexcept {
+            const float32x4_t v = Axis == STLAxis::x ? x : Axis == STLAxis::y ? y : z;
+            return vsubq_f32(v, vdupq_n_f32(plane.value));
+        }
+
+        /**
+         * 4つの三角形の頂点における平面の式の値から，平面と交わり得ない三角形のマスクを求めます
+         * @return 3頂点が全て平面の同じ側にあるレーンの全ビットが1のベクトル (NaN を含むレーンは0になり，slice_triangle_at で除かれます)
+         */
+        static inline uint32x4_t reject_plane_neon(const float32x4_t dp, const float32x4_t dq, const float32x4_t dr) noexcept {
+            const float32x4_t zero = vdupq_n_f32(0);
+            const uint32x4_t above = vandq_u32(vandq_u32(vcgeq_f32(dp, zero), vcgeq_f32(dq, zero)), vcgeq_f32(dr, zero));
+            const uint32x4_t below = vandq_u32(vandq_u32(vcltq_f32(dp, zero), vcltq_f32(dq, zero)), vcltq_f32(dr, zero));
+            return vorrq_u32(above, below);
+        }
+
+        /**
+         * 4つのベクトルを4x4の行列とみなして転置します
+         * @param rows 行のベクトル
+         * @param cols 列のベクトルの格納先
+         */
+        static inline void transpose_neon(const float32x4_t (&rows)[4], float32x4_t (&cols)[4]) noexcept {
+            const float32x4x2_t t01 = vtrnq_f32(rows[0], rows[1]);
+            const float32x4x2_t t23 = vtrnq_f32(rows[2], rows[3]);
+            cols[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+            cols[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+            cols[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+            cols[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+        }
+
+        /**
+         * ポリゴンの配列を平面でスライスします (NEON版)
+         * @details 4つのポリゴンを読み込んで成分ごとに転置し，4つの三角形の平面の式の値をまとめて求めます．
+         * 平面と交わり得るものだけを slice_triangle_at に渡します
+         */
+        template <class Plane, class Out>
+        static inline void slice_polygons_neon(
+            const STLPolygon *polygons, const std::size_t n,
+            const Plane &plane,
+            Out &res
+        ) {
+            std::size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                // ポリゴン i + k の12成分を4成分ずつ3つに分けて読み込み，部分ごとに転置する
+                float32x4_t t[3][4];
+                for (int part = 0; part < 3; ++part) {
+                    float32x4_t rows[4];
+                    for (int k = 0; k < 4; ++k) {
+                        rows[k] = vld1q_f32(&polygons[i + k].normal.x + 4 * part);
+                    }
+                    transpose_neon(rows, t[part]);
+                }
+                // 部分0: nx ny nz ax, 部分1: ay az bx by, 部分2: bz cx cy cz
+                const float32x4_t dp = plane_distance_neon(t[0][3], t[1][0], t[1][1], plane);
+                const float32x4_t dq = plane_distance_neon(t[1][2], t[1][3], t[2][0], plane);
+                const float32x4_t dr = plane_distance_neon(t[2][1], t[2][2], t[2][3], plane);
+                const uint32x4_t reject = reject_plane_neon(dp, dq, dr);
+                if (vminvq_u32(reject) != 0) {
+                    continue;
+                }
+                uint32_t lanes[4];
+                float dist[3][4];
+                vst1q_u32(lanes, reject);
+                vst1q_f32(dist[0], dp);
+                vst1q_f32(dist[1], dq);
+                vst1q_f32(dist[2], dr);
+                for (std::size_t k = 0; k < 4; ++k) {
+                    if (lanes[k] == 0) {
+                        const auto& [ ignore, p, q, r ] = polygons[i + k];
+                        slice_triangle_at(p, q, r, dist[0][k], dist[1][k], dist[2][k], plane, res);
+                    }
+                }
+            }
+            slice_polygons_scalar(polygons + i, n - i, plane, res);
+        }
+
+        /**
+         * 成分ごとの配列で保持されたポリゴンを平面でスライスします (NEON版)
+         */
+        template <class Plane, class Out>
+        static inline void slice_mesh_neon(
+            const float *const x[3], const float *const y[3], const float *const z[3],
+            const std::size_t begin, const std::size_t end,
+            const Plane &plane,
+            Out &res
+        ) {
+            std::size_t i = begin;
+            for (; i + 4 <= end; i += 4) {
+                const float32x4_t dp = plane_distance_neon(
+                    vld1q_f32(x[0] + i), vld1q_f32(y[0] + i), vld1q_f32(z[0] + i), plane);
+                const float32x4_t dq = plane_distance_neon(
+                    vld1q_f32(x[1] + i), vld1q_f32(y[1] + i), vld1q_f32(z[1] + i), plane);
+                const float32x4_t dr = plane_distance_neon(
+                    vld1q_f32(x[2] + i), vld1q_f32(y[2] + i), vld1q_f32(z[2] + i), plane);
+                const uint32x4_t reject = reject_plane_neon(dp, dq, dr);
+                if (vminvq_u32(reject) != 0) {
+                    continue;
+                }
+                uint32_t lanes[4];
+                float dist[3][4];
+                vst1q_u32(lanes, reject);
+                vst1q_f32(dist[0], dp);
+                vst1q_f32(dist[1], dq);
+                vst1q_f32(dist[2], dr);
+                for (std::size_t k = 0; k < 4; ++k) {
+                    if (lanes[k] == 0) {
+                        const std::size_t j = i + k;
+                        slice_triangle_at(
+                            { x[0][j], y[0][j], z[0][j] },
+                            { x[1][j], y[1][j], z[1][j] },
+                            { x[2][j], y[2][j], z[2][j] },
+                            dist[0][k], dist[1][k], dist[2][k], plane, res
+                        );
+                    }
+                }
+            }
+            slice_mesh_scalar(x, y, z, i, end, plane, res);
+        }
+#endif
+
+        /**
+         * ポリゴンの配列を平面でスライスします
+         * @details 実行環境で使えるSIMD命令に応じて実装を切り替えます．平面は GeneralPlane または AxisPlane です
+         */
+        template <class Plane, class Out>
+        static inline void slice_polygons(
+            const STLPolygon *polygons, const std::size_t n,
+            const Plane &plane,
+            Out &res
+        ) {
+            STLUTIL_METRIC_SLICE();
+            STLUTIL_METRIC_COUNT(triangles_tested, n);
+#if defined(STLUTIL_SIMD_AVX2)
+            if (has_avx2()) {
+                slice_polygons_avx2(polygons, n, plane, res);
+                return;
+            }
+#elif defined(STLUTIL_SIMD_NEON)
+            slice_polygons_neon(polygons, n, plane, res);
+            return;
+#endif
+            slice_polygons_scalar(polygons, n, plane, res);
+        }
+
+        /**
+         * ポリゴンの配列を ax + by + cz + d = 0 で表される平面でスライスします
+         */
+        template <class Out>
+        static inline void slice_polygons(
+            const STLPolygon *polygons, const std::size_t n,
+            const float a, const float b, const float c, const float d,
+            Out &res
+        ) {
+            slice_polygons(polygons, n, GeneralPlane { a, b, c, d }, res);
+        }
+
+        /**
+         * 成分ごとの配列で保持されたポリゴンを平面でスライスします
+         * @details 実行環境で使えるSIMD命令に応じて実装を切り替えます．平面は GeneralPlane または AxisPlane です
+         */
+        template <class Plane, class Out>
+        static inline void slice_mesh(
+            const STLMeshSoA &mesh, const std::size_t begin, const std::size_t end,
+            const Plane &plane,
+            Out &res
+        ) {
+            const float *x[3] = { mesh.x(0).data(), mesh.x(1).data(), mesh.x(2).data() };
+            const float *y[3] = { mesh.y(0).data(), mesh.y(1).data(), mesh.y(2).data() };
+            const float *z[3] = { mesh.z(0).data(), mesh.z(1).data(), mesh.z(2).data() };
+            STLUTIL_METRIC_SLICE();
+            STLUTIL_METRIC_COUNT(triangles_tested, end - begin);
+#if defined(STLUTIL_SIMD_AVX2)
+            if (has_avx2()) {
+                slice_mesh_avx2(x, y, z, begin, end, plane, res);
+                return;
+            }
+#elif defined(STLUTIL_SIMD_NEON)
+            slice_mesh_neon(x, y, z, begin, end, plane, res);
+            return;
+#endif
+            slice_mesh_scalar(x, y, z, begin, end, plane, res);
+        }
+
+        /**
+         * 成分ごとの配列で保持されたポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
+         */
+        template <class Out>
+        static inline void slice_mesh(
+            const STLMeshSoA &mesh, const std::size_t begin, const std::size_t end,
+            const float a, const float b, const float c, const float d,
+            Out &res
+        ) {
+            slice_mesh(mesh, begin, end, GeneralPlane { a, b, c, d }, res);
+        }
+    }
+
+    /**
+     * ポリゴンを座標軸に垂直な平面でスライスします
+     * @tparam Axis 平面に垂直な座標軸
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param value スライスを行う Axis 座標
+     * @return スライスして得られた線分の配列
+     * @details 平面の式の値は頂点の1成分と value の差だけで求めます．交点の Axis 座標は value に揃えます
+     */
+    template <STLAxis Axis>
+    [[nodiscard]]
+    std::vector<STLSegment> slice_polygons_at_axis(
+        const std::vector<STLPolygon> &polygons,
+        const float value
+    ) {
+        std::vector<STLSegment> res;
+        internal::slice_polygons(polygons.data(), polygons.size(), internal::AxisPlane<Axis> { value }, res);
+        return res;
+    }
+
+    /**
+     * ポリゴンを座標軸に垂直な平面でスライスし，得られた線分を既存の配列に格納します
+     * @tparam Axis 平面に垂直な座標軸
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param value スライスを行う Axis 座標
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <STLAxis Axis, class Alloc>
+    void slice_polygons_at_axis(
+        const std::vector<STLPolygon> &polygons,
+        const float value,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        res.clear();
+        res.reserve(capacity_hint);
+        internal::slice_polygons(polygons.data(), polygons.size(), internal::AxisPlane<Axis> { value }, res);
+    }
+
+    /**
+     * ポリゴンを座標軸に垂直な平面でスライスし，得られた線分を出力イテレータに書き込みます
+     * @tparam Axis 平面に垂直な座標軸
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param value スライスを行う Axis 座標
+     * @param out 線分の書き込み先
+     * @return 最後に書き込んだ線分の次を指す出力イテレータ
+     */
+    template <STLAxis Axis, class OutputIt>
+    OutputIt slice_polygons_at_axis(
+        const std::vector<STLPolygon> &polygons,
+        const float value,
+        OutputIt out
+    ) {
+        internal::OutputIteratorSink<OutputIt> sink { out };
+        internal::slice_polygons(polygons.data(), polygons.size(), internal::AxisPlane<Axis> { value }, sink);
+        return sink.it;
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを座標軸に垂直な平面でスライスします
+     * @tparam Axis 平面に垂直な座標軸
+     * @param mesh スライスの対象となるメッシュ
+     * @param value スライスを行う Axis 座標
+     * @return スライスして得られた線分の配列
+     * @details Axis 成分の配列だけを読んで平面と交わり得るポリゴンを選びます
+     */
+    template <STLAxis Axis>
+    [[nodiscard]]
+    std::vector<STLSegment> slice_polygons_at_axis(
+        const STLMeshSoA &mesh,
+        const float value
+    ) {
+        std::vector<STLSegment> res;
+        internal::slice_mesh(mesh, 0, mesh.size(), internal::AxisPlane<Axis> { value }, res);
+        return res;
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを座標軸に垂直な平面でスライスし，得られた線分を既存の配列に格納します
+     * @tparam Axis 平面に垂直な座標軸
+     * @param mesh スライスの対象となるメッシュ
+     * @param value スライスを行う Axis 座標
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <STLAxis Axis, class Alloc>
+    void slice_polygons_at_axis(
+        const STLMeshSoA &mesh,
+        const float value,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        res.clear();
+        res.reserve(capacity_hint);
+        internal::slice_mesh(mesh, 0, mesh.size(), internal::AxisPlane<Axis> { value }, res);
+    }
+
+    /**
+     * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d
+    ) noexcept {
+        std::vector<STLSegment> res;
+        internal::slice_polygons(polygons.data(), polygons.size(), a, b, c, d, res);
+        return res;
+    }
+
+    /**
+     * ポリゴンをx軸に垂直な平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param x スライスを行うx座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_x(
+        const std::vector<STLPolygon> &polygons,
+        const float x
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::x>(polygons, x);
+    }
+
+    /**
+     * ポリゴンをy軸に垂直な平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param y スライスを行うy座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_y(
+        const std::vector<STLPolygon> &polygons,
+        const float y
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::y>(polygons, y);
+    }
+
+    /**
+     * ポリゴンをz軸に垂直な平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param z スライスを行うz座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_z(
+        const std::vector<STLPolygon> &polygons,
+        const float z
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::z>(polygons, z);
+    }
+
+    /**
+     * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスし，得られた線分を既存の配列に格納します
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     * @details res には std::pmr::vector<STLSegment> などアロケータを指定した配列も使えます
+     */
+    template <class Alloc>
+    void slice_polygons_at(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        res.clear();
+        res.reserve(capacity_hint);
+        internal::slice_polygons(polygons.data(), polygons.size(), a, b, c, d, res);
+    }
+
+    /**
+     * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスし，得られた線分を出力イテレータに書き込みます
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param out 線分の書き込み先
+     * @return 最後に書き込んだ線分の次を指す出力イテレータ
+     */
+    template <class OutputIt>
+    OutputIt slice_polygons_at(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d,
+        OutputIt out
+    ) {
+        internal::OutputIteratorSink<OutputIt> sink { out };
+        internal::slice_polygons(polygons.data(), polygons.size(), a, b, c, d, sink);
+        return sink.it;
+    }
+
+    /**
+     * ポリゴンをx軸に垂直な平面でスライスし，得られた線分を既存の配列に格納します
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param x スライスを行うx座標
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <class Alloc>
+    void slice_polygons_at_x(
+        const std::vector<STLPolygon> &polygons,
+        const float x,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        slice_polygons_at_axis<STLAxis::x>(polygons, x, res, capacity_hint);
+    }
+
+    /**
+     * ポリゴンをy軸に垂直な平面でスライスし，得られた線分を既存の配列に格納します
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param y スライスを行うy座標
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <class Alloc>
+    void slice_polygons_at_y(
+        const std::vector<STLPolygon> &polygons,
+        const float y,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        slice_polygons_at_axis<STLAxis::y>(polygons, y, res, capacity_hint);
+    }
+
+    /**
+     * ポリゴンをz軸に垂直な平面でスライスし，得られた線分を既存の配列に格納します
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param z スライスを行うz座標
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <class Alloc>
+    void slice_polygons_at_z(
+        const std::vector<STLPolygon> &polygons,
+        const float z,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        slice_polygons_at_axis<STLAxis::z>(polygons, z, res, capacity_hint);
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at(
+        const STLMeshSoA &mesh,
+        const float a, const float b, const float c, const float d
+    ) noexcept {
+        std::vector<STLSegment> res;
+        internal::slice_mesh(mesh, 0, mesh.size(), a, b, c, d, res);
+        return res;
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンをx軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param x スライスを行うx座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_x(
+        const STLMeshSoA &mesh,
+        const float x
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::x>(mesh, x);
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンをy軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param y スライスを行うy座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_y(
+        const STLMeshSoA &mesh,
+        const float y
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::y>(mesh, y);
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンをz軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param z スライスを行うz座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_z(
+        const STLMeshSoA &mesh,
+        const float z
+    ) noexcept {
+        return slice_polygons_at_axis<STLAxis::z>(mesh, z);
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを ax + by + cz + d = 0 で表される平面でスライスし，得られた線分を既存の配列に格納します
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param res 線分の格納先．中身は消去されますが確保済みの領域は再利用されます
+     * @param capacity_hint 予め確保しておく線分の数
+     */
+    template <class Alloc>
+    void slice_polygons_at(
+        const STLMeshSoA &mesh,
+        const float a, const float b, const float c, const float d,
+        std::vector<STLSegment, Alloc> &res,
+        const std::size_t capacity_hint = 0
+    ) {
+        res.clear();
+        res.reserve(capacity_hint);
+        internal::slice_mesh(mesh, 0, mesh.size(), a, b, c, d, res);
+    }
+
+    namespace internal {
+
+        /**
+         * ポリゴンをz軸に垂直な複数の平面でスライスするための，z座標の昇順に並べた平面の組
+         */
+        struct ZLevelSlicer {
+            std::vector<std::size_t> order; // z座標の昇順に並べた平面の番号
+            std::vector<float> sorted; // z座標の昇順に並べた平面のz座標
+
+            /**
+             * @param levels スライスを行うz座標の配列
+             */
+            explicit ZLevelSlicer(const std::vector<float> &levels) : order(levels.size()), sorted(levels.size()) {
+                std::iota(order.begin(), order.end(), std::size_t { 0 });
+                std::stable_sort(order.begin(), order.end(), [&levels](const std::size_t i, const std::size_t j) {
+                    return levels[i] < levels[j];
+                });
+                for (std::size_t k = 0; k < order.size(); ++k) {
+                    sorted[k] = levels[order[k]];
+                }
+            }
+
+            /**
+             * ポリゴンをそのz座標の範囲に含まれる平面でスライスします
+             * @param polygon ポリゴン
+             * @param res 平面ごとの線分の追加先．元の levels と同じ順に並びます
+             */
+            template <class Levels>
+            void slice(const STLPolygon &polygon, Levels &res) const {
+                const auto& [ ignore, p, q, r ] = polygon;
+                const float lo = std::min({ p.z, q.z, r.z });
+                const float hi = std::max({ p.z, q.z, r.z });
+                for (auto it = std::lower_bound(sorted.begin(), sorted.end(), lo); it != sorted.end() && *it <= hi; ++it) {
+                    const auto k = static_cast<std::size_t>(it - sorted.begin());
+                    slice_triangle(p, q, r, AxisPlane<STLAxis::z> { *it }, res[order[k]]);
+                }
+            }
+        };
+    }
+
+    /**
+     * ポリゴンをz軸に垂直な複数の平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param levels スライスを行うz座標の配列
+     * @param res z座標ごとのスライスして得られた線分の配列の格納先．levels と同じ順に並びます
+     * @details res は levels と同じ長さに作り直されます．
+     * std::pmr::vector<std::pmr::vector<STLSegment>> を渡すと，内側の配列も外側と同じメモリリソースから確保されます
+     */
+    template <class Inner, class Alloc>
+    void slice_polygons_at_z_levels(
+        const std::vector<STLPolygon> &polygons,
+        const std::vector<float> &levels,
+        std::vector<Inner, Alloc> &res
+    ) {
+        STLUTIL_METRIC_SLICE();
+        res.clear();
+        res.resize(levels.size());
+        const internal::ZLevelSlicer slicer(levels);
+        for (const auto &polygon : polygons) {
+            slicer.slice(polygon, res);
+        }
+    }
+
+    /**
+     * ポリゴンをz軸に垂直な複数の平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param levels スライスを行うz座標の配列
+     * @return z座標ごとのスライスして得られた線分の配列．levels と同じ順に並びます
+     * @details ポリゴンの走査は1回だけで，各ポリゴンはそのz座標の範囲に含まれる平面についてのみスライスされます
+     */
+    [[nodiscard]]
+    inline std::vector<std::vector<STLSegment>> slice_polygons_at_z_levels(
+        const std::vector<STLPolygon> &polygons,
+        const std::vector<float> &levels
+    ) {
+        std::vector<std::vector<STLSegment>> res;
+        slice_polygons_at_z_levels(polygons, levels, res);
+        return res;
+    }
+
+    /**
+     * ポリゴンを等間隔に並んだz軸に垂直な平面でスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param start 最初の平面のz座標
+     * @param step 平面の間隔
+     * @param count 平面の数
+     * @return z座標ごとのスライスして得られた線分の配列．k番目は z = start + k * step での結果です
+     */
+    [[nodiscard]]
+    inline std::vector<std::vector<STLSegment>> slice_polygons_at_z_levels(
+        const std::vector<STLPolygon> &polygons,
+        const float start, const float step, const std::size_t count
+    ) {
+        std::vector<float> levels(count);
+        for (std::size_t k = 0; k < count; ++k) {
+            levels[k] = start + step * static_cast<float>(k);
+        }
+        return slice_polygons_at_z_levels(polygons, levels);
+    }
+
+    /**
+     * STLファイルを読み込みながら，z軸に垂直な複数の平面でスライスします
+     * @param path 読み込むバイナリSTLファイルへのパス
+     * @param levels スライスを行うz座標の配列
+     * @param res z座標ごとのスライスして得られた線分の配列の格納先．levels と同じ順に並びます
+     * @param batch_size 一度に読み出すポリゴンの最大数
+     * @return ファイル全体を正常に読み取れたらtrue
+     * @details ファイルの読み込みと変換は別のスレッドで行い，変換済みのポリゴンを順にスライスします．
+     * ファイル全体のポリゴンは保持しないので，使用するメモリは得られる線分の数と batch_size にだけよります．
+     * 結果は slice_polygons_at_z_levels と同じです
+     */
+    template <class Inner, class Alloc>
+    bool slice_file_at_z_levels(
+        const std::string &path,
+        const std::vector<float> &levels,
+        std::vector<Inner, Alloc> &res,
+        const std::size_t batch_size = internal::stl_block_records
+    ) {
+        res.clear();
+        res.resize(levels.size());
+        const internal::ZLevelSlicer slicer(levels);
+        return for_each_polygon_batch_pipelined(path, [&slicer, &res](const std::vector<STLPolygon> &batch) {
+            STLUTIL_METRIC_SLICE();
+            for (const auto &polygon : batch) {
+                slicer.slice(polygon, res);
+            }
+        }, batch_size);
+    }
+
+    namespace internal {
+
+        /**
+         * スレッドごとに得られた線分の配列を1つにまとめます
+         * @param parts スレッドごとの線分の配列
+         * @return まとめた線分の配列
+         */
+        [[nodiscard]]
+        static inline std::vector<STLSegment> concat_segments(std::vector<std::vector<STLSegment>> &parts) {
+            if (parts.size() == 1) {
+                return std::move(parts.front());
+            }
+            std::size_t total = 0;
+            for (const auto &part : parts) {
+                total += part.size();
+            }
+            std::vector<STLSegment> res;
+            res.reserve(total);
+            for (const auto &part : parts) {
+                res.insert(res.end(), part.begin(), part.end());
+            }
+            return res;
+        }
+
+        /**
+         * 線分を保持せずに数だけを数えるための push_back を提供します
+         */
+        struct SegmentCounter {
+            std::size_t count = 0; // 受け取った線分の数
+
+            void push_back(const STLSegment &) noexcept {
+                ++count;
+            }
+        };
+
+        /**
+         * 区間ごとに線分の数を数えてから，1つの配列のそれぞれの区間の位置に直接書き込みます
+         * @param n ポリゴンの数
+         * @param chunks 区間の数
+         * @param slice (先頭, 終端, 線分の追加先) を受け取り，その区間のポリゴンをスライスする関数
+         * @return スライスして得られた線分の配列．大きさはちょうど線分の数になります
+         * @details 2回とも同じ区間に分けてスライスするので，区間ごとの線分の数は1回目と2回目で一致します
+         */
+        template <class Slice>
+        std::vector<STLSegment> slice_counted(const std::size_t n, const std::size_t chunks, Slice &&slice) {
+            std::vector<std::size_t> offsets(chunks + 1, 0);
+            parallel_chunks(n, chunks, [&](const std::size_t i, const std::size_t begin, const std::size_t end) {
+                SegmentCounter counter;
+                slice(begin, end, counter);
+                offsets[i + 1] = counter.count;
+            });
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            std::vector<STLSegment> res(offsets.back());
+            parallel_chunks(n, chunks, [&](const std::size_t i, const std::size_t begin, const std::size_t end) {
+                OutputIteratorSink<STLSegment *> sink { res.data() + offsets[i] };
+                slice(begin, end, sink);
+            });
+            return res;
+        }
+    }
+
+    /**
+     * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスしたときに得られる線分の数を求めます
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return slice_polygons_at で得られる線分の数
+     * @details slice_polygons_at と同じ処理で数えるので，長さ0の線分を除いた数と正確に一致します．
+     * 交点の計算は平面をまたぐポリゴンについてのみ行い，線分は書き込みません
+     */
+    [[nodiscard]]
+    inline std::size_t count_slice_segments(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d
+    ) {
+        internal::SegmentCounter counter;
+        internal::slice_polygons(polygons.data(), polygons.size(), a, b, c, d, counter);
+        return counter.count;
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを ax + by + cz + d = 0 で表される平面でスライスしたときに得られる線分の数を求めます
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return slice_polygons_at で得られる線分の数
+     */
+    [[nodiscard]]
+    inline std::size_t count_slice_segments(
+        const STLMeshSoA &mesh,
+        const float a, const float b, const float c, const float d
+    ) {
+        internal::SegmentCounter counter;
+        internal::slice_mesh(mesh, 0, mesh.size(), a, b, c, d, counter);
+        return counter.count;
+    }
+
+    /**
+     * ポリゴンを ax + by + cz + d = 0 で表される平面で並列にスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param threads 使用するスレッド数．0ならハードウェアの並列数
+     * @return スライスして得られた線分の配列．順序は slice_polygons_at と同じです
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_parallel(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d,
+        const unsigned int threads = 0
+    ) {
+        const std::size_t chunks = internal::thread_count(threads, polygons.size(), internal::parallel_min_polygons);
+        std::vector<std::vector<STLSegment>> parts(chunks);
+        internal::parallel_chunks(polygons.size(), chunks, [&](const std::size_t i, const std::size_t begin, const std::size_t end) {
+            internal::slice_polygons(polygons.data() + begin, end - begin, a, b, c, d, parts[i]);
+        });
+        return internal::concat_segments(parts);
+    }
+
+    /**
+     * 成分ごとの配列で保持されたポリゴンを ax + by + cz + d = 0 で表される平面で並列にスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param threads 使用するスレッド数．0ならハードウェアの並列数
+     * @return スライスして得られた線分の配列．順序は slice_polygons_at と同じです
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_parallel(
+        const STLMeshSoA &mesh,
+        const float a, const float b, const float c, const float d,
+        const unsigned int threads = 0
+    ) {
+        const std::size_t chunks = internal::thread_count(threads, mesh.size(), internal::parallel_min_polygons);
+        std::vector<std::vector<STLSegment>> parts(chunks);
+        internal::parallel_chunks(mesh.size(), chunks, [&](const std::size_t i, const std::size_t begin, const std::size_t end) {
+            internal::slice_mesh(mesh, begin, end, a, b, c, d, parts[i]);
+        });
+        return internal::concat_segments(parts);
+    }
+
+    /**
+     * 線分の数を数えてから，ちょうどの大きさの配列にポリゴンをスライスします
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param threads 使用するスレッド数．0ならハードウェアの並列数
+     * @return スライスして得られた線分の配列．順序は slice_polygons_at と同じです
+     * @details ポリゴンを2回走査する代わりに，配列の再確保やスレッドごとの結果の連結を行いません．
+     * 各スレッドは結果の配列のうち自分の区間に直接書き込みます．得られる線分が非常に多い場合や，
+     * 結果の2倍のメモリを一時的にも使いたくない場合に使います
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_counted(
+        const std::vector<STLPolygon> &polygons,
+        const float a, const float b, const float c, const float d,
+        const unsigned int threads = 1
+    ) {
+        const std::size_t chunks = internal::thread_count(threads, polygons.size(), internal::parallel_min_polygons);
+        return internal::slice_counted(polygons.size(), chunks, [&](const std::size_t begin, const std::size_t end, auto &res) {
+            internal::slice_polygons(polygons.data() + begin, end - begin, a, b, c, d, res);
+        });
+    }
+
+    /**
+     * 線分の数を数えてから，成分ごとの配列で保持されたポリゴンをちょうどの大きさの配列にスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @param threads 使用するスレッド数．0ならハードウェアの並列数
+     * @return スライスして得られた線分の配列．順序は slice_polygons_at と同じです
+     * @details 詳細は std::vector<STLPolygon> を受け取るものを参照してください
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_counted(
+        const STLMeshSoA &mesh,
+        const float a, const float b, const float c, const float d,
+        const unsigned int threads = 1
+    ) {
+        const std::size_t chunks = internal::thread_count(threads, mesh.size(), internal::parallel_min_polygons);
+        return internal::slice_counted(mesh.size(), chunks, [&](const std::size_t begin, const std::size_t end, auto &res) {
+            internal::slice_mesh(mesh, begin, end, a, b, c, d, res);
+        });
+    }
+
+    namespace internal {
+
+        /**
+         * STLSliceIndex のバケット
+         * @details バケット内のポリゴンはz座標の最大値の降順に並んでいます
+         */
+        struct SliceIndexBucket {
+            std::uint32_t begin; // バケットの先頭のポリゴンの番号
+            std::uint32_t end; // バケットの終端のポリゴンの番号
+            float min_z; // バケット内のポリゴンのz座標の最小値
+            float max_z; // バケット内のポリゴンのz座標の最大値
+        };
+
+        /**
+         * 平面 z = const と交わり得るポリゴンを列挙します
+         * @param buckets バケットの配列．min_z の昇順に並んでいる必要があります
+         * @param bucket_count バケットの数
+         * @param min_z ポリゴンごとのz座標の最小値の配列
+         * @param max_z ポリゴンごとのz座標の最大値の配列
+         * @param z スライスを行うz座標
+         * @param f ポリゴンの番号を受け取る関数
+         */
+        template <class F>
+        void for_each_slice_candidate(
+            const SliceIndexBucket *buckets, const std::size_t bucket_count,
+            const float *min_z, const float *max_z,
+            const float z, F &&f
+        ) {
+            for (std::size_t k = 0; k < bucket_count && buckets[k].min_z <= z; ++k) {
+                if (buckets[k].max_z < z) {
+                    continue;
+                }
+                for (std::size_t i = buckets[k].begin; i < buckets[k].end && max_z[i] >= z; ++i) {
+                    if (min_z[i] <= z) {
+                        f(i);
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * 平面 z = const によるスライスを高速に行うための索引
+     * @details ポリゴンをz座標の最小値でバケットに分け，各バケット内をz座標の最大値で並べておくことで，
+     * 平面と交わり得るポリゴンだけを調べます
+     */
+    struct STLSliceIndex {
+    private:
+        std::vector<STLPolygon> polygons_; // 索引の順に並べ替えたポリゴンの配列
+        std::vector<std::uint32_t> indices_; // 並べ替える前のポリゴンの番号
+        std::vector<float> min_z_; // ポリゴンごとのz座標の最小値
+        std::vector<float> max_z_; // ポリゴンごとのz座標の最大値
+        std::vector<internal::SliceIndexBucket> buckets_; // バケットの配列
+
+        /**
+         * ポリゴンのz座標の範囲から索引を作成します
+         * @param polygons ポリゴンの配列
+         * @param lo ポリゴンごとのz座標の最小値
+         * @param hi ポリゴンごとのz座標の最大値
+         * @param bucket_size 1つのバケットに入れるポリゴンの数．0ならポリゴンの数の平方根程度
+         * @details NaN を比較すると並べ替えの順序が壊れるので，範囲に NaN を含むポリゴンはどの平面とも交わらないものとして扱います
+         */
+        void build(const std::vector<STLPolygon> &polygons, std::vector<float> lo, std::vector<float> hi, std::size_t bucket_size) {
+            const std::size_t n = polygons.size();
+            for (std::size_t i = 0; i < n; ++i) {
+                if (std::isnan(lo[i]) || std::isnan(hi[i])) {
+                    lo[i] = std::numeric_limits<float>::infinity();
+                    hi[i] = -std::numeric_limits<float>::infinity();
+                }
+            }
+            if (bucket_size == 0) {
+                bucket_size = std::max<std::size_t>(64, static_cast<std::size_t>(std::sqrt(static_cast<double>(n))));
+            }
+            indices_.resize(n);
+            std::iota(indices_.begin(), indices_.end(), 0u);
+            std::sort(indices_.begin(), indices_.end(), [&lo](const std::uint32_t i, const std::uint32_t j) {
+                return lo[i] < lo[j];
+            });
+            for (std::size_t begin = 0; begin < n; begin += bucket_size) {
+                const std::size_t end = std::min(n, begin + bucket_size);
+                std::sort(indices_.begin() + begin, indices_.begin() + end, [&hi](const std::uint32_t i, const std::uint32_t j) {
+                    return hi[i] > hi[j];
+                });
+                internal::SliceIndexBucket bucket {
+                    static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(end),
+                    std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()
+                };
+                for (std::size_t i = begin; i < end; ++i) {
+                    bucket.min_z = std::min(bucket.min_z, lo[indices_[i]]);
+                    bucket.max_z = std::max(bucket.max_z, hi[indices_[i]]);
+                }
+                buckets_.push_back(bucket);
+            }
+            polygons_.resize(n);
+            min_z_.resize(n);
+            max_z_.resize(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                polygons_[i] = polygons[indices_[i]];
+                min_z_[i] = lo[indices_[i]];
+                max_z_[i] = hi[indices_[i]];
+            }
+        }
+
+    public:
+        /**
+         * ポリゴンの配列から索引を作成します
+         * @param polygons ポリゴンの配列
+         * @param bucket_size 1つのバケットに入れるポリゴンの数．0ならポリゴンの数の平方根程度
+         */
+        explicit STLSliceIndex(const std::vector<STLPolygon> &polygons, const std::size_t bucket_size = 0) {
+            const std::size_t n = polygons.size();
+            std::vector<float> lo(n), hi(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto& [ ignore, a, b, c ] = polygons[i];
+                if (std::isnan(a.z) || std::isnan(b.z) || std::isnan(c.z)) {
+                    // 平面の値がNaNになる三角形はスライスされないので，どの平面とも交わらないものとして扱う
+                    lo[i] = std::numeric_limits<float>::infinity();
+                    hi[i] = -std::numeric_limits<float>::infinity();
+                    continue;
+                }
+                lo[i] = std::min({ a.z, b.z, c.z });
+                hi[i] = std::max({ a.z, b.z, c.z });
+            }
+            build(polygons, std::move(lo), std::move(hi), bucket_size);
+        }
+
+        /**
+         * 読み込み済みのSTLファイルから索引を作成します
+         * @param reader 読み込み済みのSTLファイル
+         * @param bucket_size 1つのバケットに入れるポリゴンの数．0ならポリゴンの数の平方根程度
+         * @details 読み込み時に包含箱を求めていれば，そのz座標の範囲を使います
+         */
+        explicit STLSliceIndex(const STLReader &reader, const std::size_t bucket_size = 0) {
+            const auto &bounds = reader.polygon_bounds();
+            if (bounds.size() == reader.polygons().size()) {
+                build(reader.polygons(), bounds.min_z, bounds.max_z, bucket_size);
+            } else {
+                *this = STLSliceIndex(reader.polygons(), bucket_size);
+            }
+        }
+
+        /**
+         * 平面 z = const と交わり得るポリゴンを列挙します
+         * @param z スライスを行うz座標
+         * @param f ポリゴンを受け取る関数
+         */
+        template <class F>
+        void for_each_candidate(const float z, F &&f) const {
+            internal::for_each_slice_candidate(
+                buckets_.data(), buckets_.size(), min_z_.data(), max_z_.data(), z,
+                [this, &f](const std::size_t i) { f(polygons_[i]); }
+            );
+        }
+
+        /**
+         * ポリゴンをz軸に垂直な平面でスライスします
+         * @param z スライスを行うz座標
+         * @return スライスして得られた線分の配列
+         */
+        [[nodiscard]]
+        std::vector<STLSegment> slice_at_z(const float z) const {
+            STLUTIL_METRIC_SLICE();
+            std::vector<STLSegment> res;
+            for_each_candidate(z, [&res, z](const STLPolygon &polygon) {
+                internal::slice_triangle(polygon.a, polygon.b, polygon.c, internal::AxisPlane<STLAxis::z> { z }, res);
+            });
+            return res;
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return polygons_.size();
+        }
+
+        /**
+         * @return 索引の順に並べ替えたポリゴンの配列への参照
+         */
+        [[nodiscard]]
+        const auto &polygons() const noexcept {
+            return polygons_;
+        }
+
+        /**
+         * @return 並べ替えたポリゴンそれぞれの，元の配列での番号
+         */
+        [[nodiscard]]
+        const auto &indices() const noexcept {
+            return indices_;
+        }
+
+        /**
+         * @return 並べ替えたポリゴンごとのz座標の最小値の配列
+         */
+        [[nodiscard]]
+        const auto &min_z() const noexcept {
+            return min_z_;
+        }
+
+        /**
+         * @return 並べ替えたポリゴンごとのz座標の最大値の配列
+         */
+        [[nodiscard]]
+        const auto &max_z() const noexcept {
+            return max_z_;
+        }
+
+        /**
+         * @return バケットの配列
+         * @details 索引をファイルに保存するための内部表現です
+         */
+        [[nodiscard]]
+        const auto &buckets() const noexcept {
+            return buckets_;
+        }
+    };
+
+    /**
+     * 索引を使ってポリゴンをz軸に垂直な平面でスライスします
+     * @param index スライスの対象となるポリゴンの索引
+     * @param z スライスを行うz座標
+     * @return スライスして得られた線分の配列．順序は索引の順になります
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_z(
+        const STLSliceIndex &index,
+        const float z
+    ) {
+        return index.slice_at_z(z);
+    }
+
+    /**
+     * 平面 z = const によるスライスの結果を保持し，近いz座標でのスライスを差分で行うためのキャッシュ
+     * @details 結果は量子化したz座標ごとに保持され，使用するメモリの上限を超えると最も長く使われていない結果から破棄されます．
+     * また直前のz座標で平面と交わるポリゴンの集合を保持し，z座標の範囲に平面が出入りしたポリゴンだけを更新するので，
+     * z座標を少しずつ変えながらスライスする場合はポリゴン全体を走査しません
+     */
+    struct STLSliceCache {
+    private:
+        /**
+         * 保持しているスライスの結果
+         */
+        struct Entry {
+            std::uint32_t key; // 量子化したz座標のビット列
+            std::vector<STLSegment> segments; // スライスして得られた線分の配列
+        };
+
+        static constexpr std::uint32_t inactive = std::numeric_limits<std::uint32_t>::max(); // 平面と交わらないポリゴンの位置
+
+        std::vector<STLPolygon> polygons_; // ポリゴンの配列
+        std::vector<std::uint32_t> by_min_; // z座標の最小値の昇順に並べたポリゴンの番号
+        std::vector<float> sorted_min_; // by_min_ の順に並べたz座標の最小値
+        std::vector<std::uint32_t> by_max_; // z座標の最大値の昇順に並べたポリゴンの番号
+        std::vector<float> sorted_max_; // by_max_ の順に並べたz座標の最大値
+        std::vector<float> min_z_; // ポリゴンごとのz座標の最小値
+        std::vector<float> max_z_; // ポリゴンごとのz座標の最大値
+        std::vector<std::uint32_t> active_; // 平面 z = current_z_ と交わるポリゴンの番号
+        std::vector<std::uint32_t> position_; // ポリゴンごとの active_ での位置
+        float current_z_ = -std::numeric_limits<float>::infinity(); // active_ が表す平面のz座標
+
+        std::list<Entry> entries_; // 保持しているスライスの結果．先頭ほど最近使われたもの
+        std::unordered_map<std::uint32_t, std::list<Entry>::iterator> lookup_; // z座標から結果を引くための表
+        std::size_t byte_budget_; // 結果の保持に使うメモリの上限 [byte]
+        std::size_t bytes_ = 0; // 結果の保持に使っているメモリ [byte]
+        float quantum_; // z座標を量子化する間隔．0なら量子化しない
+        std::vector<STLSegment> last_; // 保持しなかった結果
+
+        /**
+         * @param entry 保持しているスライスの結果
+         * @return 結果の保持に使うメモリの見積もり [byte]
+         */
+        [[nodiscard]]
+        static std::size_t entry_bytes(const Entry &entry) noexcept {
+            return sizeof(Entry) + entry.segments.capacity() * sizeof(STLSegment) + 4 * sizeof(void *);
+        }
+
+        /**
+         * ポリゴンが平面と交わるかどうかを更新します
+         * @param i ポリゴンの番号
+         * @param z 平面のz座標
+         */
+        void update(const std::uint32_t i, const float z) {
+            const bool crossing = min_z_[i] < z && max_z_[i] >= z;
+            if (crossing && position_[i] == inactive) {
+                position_[i] = static_cast<std::uint32_t>(active_.size());
+                active_.push_back(i);
+            } else if (!crossing && position_[i] != inactive) {
+                const std::uint32_t back = active_.back();
+                active_[position_[i]] = back;
+                position_[back] = position_[i];
+                active_.pop_back();
+                position_[i] = inactive;
+            }
+        }
+
+        /**
+         * 平面と交わるポリゴンの集合を平面 z = const のものに更新します
+         * @param z 平面のz座標
+         */
+        void move_to(const float z) {
+            const float lo = std::min(current_z_, z);
+            const float hi = std::max(current_z_, z);
+            const auto min_begin = std::lower_bound(sorted_min_.begin(), sorted_min_.end(), lo) - sorted_min_.begin();
+            const auto min_end = std::lower_bound(sorted_min_.begin(), sorted_min_.end(), hi) - sorted_min_.begin();
+            const auto max_begin = std::lower_bound(sorted_max_.begin(), sorted_max_.end(), lo) - sorted_max_.begin();
+            const auto max_end = std::lower_bound(sorted_max_.begin(), sorted_max_.end(), hi) - sorted_max_.begin();
+            const auto below = std::lower_bound(sorted_min_.begin(), sorted_min_.end(), z) - sorted_min_.begin();
+            if ((min_end - min_begin) + (max_end - max_begin) > below) {
+                // 出入りするポリゴンが多い場合は，z座標の最小値が平面より下にあるポリゴンを調べ直す
+                for (const std::uint32_t i : active_) {
+                    position_[i] = inactive;
+                }
+                active_.clear();
+                for (std::ptrdiff_t k = 0; k < below; ++k) {
+                    update(by_min_[k], z);
+                }
+            } else {
+                // z座標の範囲の端が current_z_ と z の間にあるポリゴンだけが出入りする
+                for (auto k = min_begin; k < min_end; ++k) {
+                    update(by_min_[k], z);
+                }
+                for (auto k = max_begin; k < max_end; ++k) {
+                    update(by_max_[k], z);
+                }
+            }
+            current_z_ = z;
+        }
+
+    public:
+        /**
+         * ポリゴンの配列からキャッシュを作成します
+         * @param polygons ポリゴンの配列
+         * @param byte_budget 結果の保持に使うメモリの上限 [byte]
+         * @param quantum z座標を量子化する間隔．0より大きければ，z座標をこの間隔の倍数に丸めてからスライスします
+         */
+        explicit STLSliceCache(
+            const std::vector<STLPolygon> &polygons,
+            const std::size_t byte_budget = std::size_t { 64 } << 20,
+            const float quantum = 0
+        ) : polygons_(polygons), min_z_(polygons.size()), max_z_(polygons.size()),
+            position_(polygons.size(), inactive), byte_budget_(byte_budget), quantum_(quantum) {
+            const std::size_t n = polygons_.size();
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto& [ ignore, a, b, c ] = polygons_[i];
+                if (std::isnan(a.z) || std::isnan(b.z) || std::isnan(c.z)) {
+                    // 平面の値がNaNになる三角形はスライスされないので，どの平面とも交わらないものとして扱う
+                    min_z_[i] = std::numeric_limits<float>::infinity();
+                    max_z_[i] = -std::numeric_limits<float>::infinity();
+                    continue;
+                }
+                min_z_[i] = std::min({ a.z, b.z, c.z });
+                max_z_[i] = std::max({ a.z, b.z, c.z });
+            }
+            by_min_.resize(n);
+            std::iota(by_min_.begin(), by_min_.end(), 0u);
+            by_max_ = by_min_;
+            std::sort(by_min_.begin(), by_min_.end(), [this](const std::uint32_t i, const std::uint32_t j) {
+                return min_z_[i] < min_z_[j];
+            });
+            std::sort(by_max_.begin(), by_max_.end(), [this](const std::uint32_t i, const std::uint32_t j) {
+                return max_z_[i] < max_z_[j];
+            });
+            sorted_min_.resize(n);
+            sorted_max_.resize(n);
+            for (std::size_t k = 0; k < n; ++k) {
+                sorted_min_[k] = min_z_[by_min_[k]];
+                sorted_max_[k] = max_z_[by_max_[k]];
+            }
+        }
+
+        /**
+         * 読み込み済みのSTLファイルからキャッシュを作成します
+         * @param reader 読み込み済みのSTLファイル
+         * @param byte_budget 結果の保持に使うメモリの上限 [byte]
+         * @param quantum z座標を量子化する間隔．0より大きければ，z座標をこの間隔の倍数に丸めてからスライスします
+         */
+        explicit STLSliceCache(
+            const STLReader &reader,
+            const std::size_t byte_budget = std::size_t { 64 } << 20,
+            const float quantum = 0
+        ) : STLSliceCache(reader.polygons(), byte_budget, quantum) {}
+
+        /**
+         * ポリゴンをz軸に垂直な平面でスライスします
+         * @param z スライスを行うz座標
+         * @return スライスして得られた線分の配列への参照．次にこのキャッシュを変更するまで有効です
+         * @details 線分は slice_polygons_at_z と同じものが得られますが，順序は不定です
+         */
+        [[nodiscard]]
+        const std::vector<STLSegment> &slice_at_z(float z) {
+            if (quantum_ > 0) {
+                z = std::round(z / quantum_) * quantum_;
+            }
+            z += 0.0f; // -0 を +0 にそろえる
+            if (std::isnan(z)) {
+                last_.clear();
+                return last_;
+            }
+            std::uint32_t key;
+            std::memcpy(&key, &z, sizeof(key));
+            if (const auto it = lookup_.find(key); it != lookup_.end()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return it->second->segments;
+            }
+
+            STLUTIL_METRIC_SLICE();
+            move_to(z);
+            std::vector<STLSegment> segments;
+            segments.reserve(active_.size());
+            const internal::AxisPlane<STLAxis::z> plane { z };
+            for (const std::uint32_t i : active_) {
+                const auto& [ ignore, a, b, c ] = polygons_[i];
+                internal::slice_triangle(a, b, c, plane, segments);
+            }
+
+            Entry entry { key, std::move(segments) };
+            const std::size_t bytes = entry_bytes(entry);
+            if (bytes > byte_budget_) {
+                last_ = std::move(entry.segments);
+                return last_;
+            }
+            while (bytes_ + bytes > byte_budget_) {
+                bytes_ -= entry_bytes(entries_.back());
+                lookup_.erase(entries_.back().key);
+                entries_.pop_back();
+            }
+            entries_.push_front(std::move(entry));
+            lookup_.emplace(key, entries_.begin());
+            bytes_ += bytes;
+            return entries_.front().segments;
+        }
+
+        /**
+         * 保持しているスライスの結果を全て破棄します
+         */
+        void clear() noexcept {
+            entries_.clear();
+            lookup_.clear();
+            bytes_ = 0;
+        }
+
+        /**
+         * @return 保持しているスライスの結果の数
+         */
+        [[nodiscard]]
+        std::size_t cached_count() const noexcept {
+            return entries_.size();
+        }
+
+        /**
+         * @return 結果の保持に使っているメモリの見積もり [byte]
+         */
+        [[nodiscard]]
+        std::size_t cached_bytes() const noexcept {
+            return bytes_;
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return polygons_.size();
+        }
+
+        /**
+         * @return ポリゴンの配列への参照
+         */
+        [[nodiscard]]
+        const auto &polygons() const noexcept {
+            return polygons_;
+        }
+    };
+
+    /**
+     * 線分をつなげて得られる折れ線を表す構造体
+     */
+    struct STLContour {
+        std::vector<STLVector> points; // 折れ線の頂点の配列．閉じている場合も始点を末尾に繰り返しません
+        bool closed; // 閉じた折れ線かどうか
+    };
+
+    namespace internal {
+
+        /**
+         * 座標を量子化して得られる格子の座標
+         */
+        struct GridCell {
+            std::int64_t x, y, z; // 格子の座標
+
+            friend bool operator==(const GridCell &lhs, const GridCell &rhs) noexcept {
+                return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z;
+            }
+        };
+
+        /**
+         * GridCell のハッシュ関数
+         */
+        struct GridCellHash {
+            std::size_t operator()(const GridCell &cell) const noexcept {
+                std::uint64_t h = static_cast<std::uint64_t>(cell.x) * 0x9e3779b97f4a7c15ull;
+                h ^= static_cast<std::uint64_t>(cell.y) + 0x7f4a7c159e3779b9ull + (h << 6) + (h >> 2);
+                h ^= static_cast<std::uint64_t>(cell.z) + 0x94d049bb133111ebull + (h << 6) + (h >> 2);
+                return static_cast<std::size_t>(h);
+            }
+        };
+
+        /**
+         * 点が属する格子を求めます
+         * @param v 点
+         * @param size 格子の大きさ．0なら座標のビット列をそのまま格子の座標とします
+         * @return 格子の座標
+         */
+        [[nodiscard]]
+        static inline GridCell grid_cell(const STLVector &v, const float size) noexcept {
+            if (size == 0) {
+                const auto key = [](float f) {
+                    if (f == 0) {
+                        f = 0; // -0 と +0 を同一視する
+                    }
+                    std::uint32_t bits;
+                    std::memcpy(&bits, &f, 4);
+                    return static_cast<std::int64_t>(bits);
+                };
+                return { key(v.x), key(v.y), key(v.z) };
+            }
+            return {
+                static_cast<std::int64_t>(std::floor(v.x / size)),
+                static_cast<std::int64_t>(std::floor(v.y / size)),
+                static_cast<std::int64_t>(std::floor(v.z / size))
+            };
+        }
+
+        /**
+         * 線分の端点をハッシュ表で検索するための構造体
+         * @details 端点の番号 e は線分 e / 2 の始点 (e % 2 == 0) または終点 (e % 2 == 1) を表します
+         */
+        struct EndpointMap {
+        private:
+            const std::vector<STLSegment> &segments_; // 線分の配列
+            const float tolerance_; // 同一とみなす端点の距離
+            std::unordered_map<GridCell, std::uint32_t, GridCellHash> head_; // 格子ごとの最初の端点
+            std::vector<std::uint32_t> next_; // 同じ格子に属する次の端点
+
+            [[nodiscard]]
+            GridCell cell(const STLVector &v) const noexcept {
+                return grid_cell(v, tolerance_);
+            }
+
+        public:
+            static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max(); // 端点が無いことを表す値
+
+            EndpointMap(const std::vector<STLSegment> &segments, const float tolerance)
+                : segments_(segments), tolerance_(tolerance), next_(2 * segments.size(), npos) {
+                head_.reserve(2 * segments.size());
+                for (std::uint32_t e = 0; e < next_.size(); ++e) {
+                    auto [ it, inserted ] = head_.try_emplace(cell(point(e)), e);
+                    if (!inserted) {
+                        next_[e] = it->second;
+                        it->second = e;
+                    }
+                }
+            }
+
+            /**
+             * @param e 端点の番号
+             * @return 端点の座標
+             */
+            [[nodiscard]]
+            const STLVector &point(const std::uint32_t e) const noexcept {
+                return e % 2 == 0 ? segments_[e / 2].p : segments_[e / 2].q;
+            }
+
+            /**
+             * v と同一とみなせる端点のうち，まだ使われていない線分のものを探します
+             * @param v 探す位置
+             * @param used 線分ごとの使用済みかどうか
+             * @param prefer 優先する端点の種類 (0: 始点, 1: 終点)
+             * @return 見つかった端点の番号．見つからなければ npos
+             */
+            [[nodiscard]]
+            std::uint32_t find(const STLVector &v, const std::vector<bool> &used, const std::uint32_t prefer) const {
+                std::uint32_t found = npos;
+                const auto visit = [&](const GridCell &c) {
+                    const auto it = head_.find(c);
+                    if (it == head_.end()) {
+                        return false;
+                    }
+                    for (std::uint32_t e = it->second; e != npos; e = next_[e]) {
+                        if (used[e / 2]) {
+                            continue;
+                        }
+                        if (tolerance_ != 0) {
+                            const STLVector &w = point(e);
+                            const float dx = w.x - v.x, dy = w.y - v.y, dz = w.z - v.z;
+                            if (dx * dx + dy * dy + dz * dz > tolerance_ * tolerance_) {
+                                continue;
+                            }
+                        }
+                        if (e % 2 == prefer) {
+                            found = e;
+                            return true;
+                        }
+                        if (found == npos) {
+                            found = e;
+                        }
+                    }
+                    return false;
+                };
+                const GridCell center = cell(v);
+                if (visit(center) || tolerance_ == 0) {
+                    return found;
+                }
+                for (std::int64_t dx = -1; dx <= 1; ++dx) {
+                    for (std::int64_t dy = -1; dy <= 1; ++dy) {
+                        for (std::int64_t dz = -1; dz <= 1; ++dz) {
+                            if ((dx != 0 || dy != 0 || dz != 0) && visit({ center.x + dx, center.y + dy, center.z + dz })) {
+                                return found;
+                            }
+                        }
+                    }
+                }
+                return found;
+            }
+        };
+    }
+
+    /**
+     * 線分を端点でつなげて折れ線にします
+     * @param segments つなげる線分の配列
+     * @param tolerance 同一とみなす端点の距離．0なら座標が完全に一致する端点のみをつなげます
+     * @return 折れ線の配列
+     * @details 端点を量子化したハッシュ表で探索するため，線分の数に対してほぼ線形の時間で処理します．
+     * 線分は可能な限り向きを保ってつなげ，向きが逆の線分は反転してつなげます
+     */
+    [[nodiscard]]
+    inline std::vector<STLContour> stitch_segments(
+        const std::vector<STLSegment> &segments,
+        const float tolerance = 0
+    ) {
+        const internal::EndpointMap endpoints(segments, tolerance);
+        std::vector<bool> used(segments.size(), false);
+        std::vector<STLContour> res;
+        for (std::size_t s = 0; s < segments.size(); ++s) {
+            if (used[s]) {
+                continue;
+            }
+            used[s] = true;
+            std::vector<STLVector> forward { segments[s].p, segments[s].q };
+            // 終点側へ伸ばす
+            for (;;) {
+                const std::uint32_t e = endpoints.find(forward.back(), used, 0);
+                if (e == internal::EndpointMap::npos) {
+                    break;
+                }
+                used[e / 2] = true;
+                forward.push_back(endpoints.point(e ^ 1u));
+            }
+            const STLVector &first = forward.front(), &last = forward.back();
+            const float dx = first.x - last.x, dy = first.y - last.y, dz = first.z - last.z;
+            if (forward.size() > 2 && dx * dx + dy * dy + dz * dz <= tolerance * tolerance) {
+                forward.pop_back();
+                res.push_back({ std::move(forward), true });
+                continue;
+            }
+            // 始点側へ伸ばす
+            std::vector<STLVector> backward;
+            for (STLVector front = forward.front();;) {
+                const std::uint32_t e = endpoints.find(front, used, 1);
+                if (e == internal::EndpointMap::npos) {
+                    break;
+                }
+                used[e / 2] = true;
+                front = endpoints.point(e ^ 1u);
+                backward.push_back(front);
+            }
+            std::vector<STLVector> points(backward.rbegin(), backward.rend());
+            points.insert(points.end(), forward.begin(), forward.end());
+            res.push_back({ std::move(points), false });
+        }
+        return res;
+    }
+
+    /**
+     * 重複する頂点をまとめ，頂点の配列と添字の配列でポリゴンを表す構造体
+     * @details ポリゴン i の頂点は vertices()[indices()[3 * i + k]] (k = 0, 1, 2) です．法線ベクトルは保持しません
+     */
+    struct STLIndexedMesh {
+    private:
+        std::vector<STLVector> vertices_; // 重複の無い頂点の配列
+        std::vector<std::uint32_t> indices_; // ポリゴンごとの3頂点の添字の配列
+
+    public:
+        static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max(); // 隣接する辺が無いことを表す値
+
+        STLIndexedMesh() noexcept = default;
+
+        /**
+         * ポリゴンの配列から頂点をまとめたメッシュを作成します
+         * @param polygons ポリゴンの配列
+         * @param epsilon 同一とみなす頂点の距離．0なら座標が完全に一致する頂点のみをまとめます
+         */
+        explicit STLIndexedMesh(const std::vector<STLPolygon> &polygons, const float epsilon = 0) {
+            indices_.reserve(3 * polygons.size());
+            vertices_.reserve(polygons.size() / 2 + 3);
+            std::unordered_map<internal::GridCell, std::uint32_t, internal::GridCellHash> head; // 格子ごとの最初の頂点
+            std::vector<std::uint32_t> next; // 同じ格子に属する次の頂点
+            head.reserve(polygons.size() / 2 + 3);
+            const auto find = [&](const internal::GridCell &cell, const STLVector &v) {
+                const auto it = head.find(cell);
+                if (it == head.end()) {
+                    return npos;
+                }
+                for (std::uint32_t i = it->second; i != npos; i = next[i]) {
+                    const STLVector &w = vertices_[i];
+                    const float dx = w.x - v.x, dy = w.y - v.y, dz = w.z - v.z;
+                    if (epsilon == 0 || dx * dx + dy * dy + dz * dz <= epsilon * epsilon) {
+                        return i;
+                    }
+                }
+                return npos;
+            };
+            const auto weld = [&](const STLVector &v) {
+                const internal::GridCell center = internal::grid_cell(v, epsilon);
+                std::uint32_t found = find(center, v);
+                for (std::int64_t dx = -1; epsilon != 0 && found == npos && dx <= 1; ++dx) {
+                    for (std::int64_t dy = -1; found == npos && dy <= 1; ++dy) {
+                        for (std::int64_t dz = -1; found == npos && dz <= 1; ++dz) {
+                            if (dx != 0 || dy != 0 || dz != 0) {
+                                found = find({ center.x + dx, center.y + dy, center.z + dz }, v);
+                            }
+                        }
+                    }
+                }
+                if (found != npos) {
+                    return found;
+                }
+                const auto index = static_cast<std::uint32_t>(vertices_.size());
+                vertices_.push_back(v);
+                auto [ it, inserted ] = head.try_emplace(center, index);
+                next.push_back(inserted ? npos : it->second);
+                it->second = index;
+                return index;
+            };
+            for (const auto& [ ignore, a, b, c ] : polygons) {
+                indices_.push_back(weld(a));
+                indices_.push_back(weld(b));
+                indices_.push_back(weld(c));
+            }
+            vertices_.shrink_to_fit();
+        }
+
+        /**
+         * 読み込み済みのSTLファイルから頂点をまとめたメッシュを作成します
+         * @param reader 読み込み済みのSTLファイル
+         * @param epsilon 同一とみなす頂点の距離．0なら座標が完全に一致する頂点のみをまとめます
+         */
+        explicit STLIndexedMesh(const STLReader &reader, const float epsilon = 0)
+            : STLIndexedMesh(reader.polygons(), epsilon) {}
+
+        /**
+         * 頂点の配列と添字の配列からメッシュを作成します
+         * @param vertices 頂点の配列
+         * @param indices ポリゴンごとの3頂点の添字の配列
+         */
+        STLIndexedMesh(std::vector<STLVector> vertices, std::vector<std::uint32_t> indices) noexcept
+            : vertices_(std::move(vertices)), indices_(std::move(indices)) {}
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return indices_.size() / 3;
+        }
+
+        /**
+         * @return 頂点の配列への参照
+         */
+        [[nodiscard]]
+        const auto &vertices() const noexcept {
+            return vertices_;
+        }
+
+        /**
+         * @return ポリゴンごとの3頂点の添字の配列への参照
+         */
+        [[nodiscard]]
+        const auto &indices() const noexcept {
+            return indices_;
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return i番目のポリゴン．法線ベクトルは頂点から計算した単位ベクトルです
+         */
+        [[nodiscard]]
+        STLPolygon polygon(const std::size_t i) const noexcept {
+            const STLVector &a = vertices_[indices_[3 * i]];
+            const STLVector &b = vertices_[indices_[3 * i + 1]];
+            const STLVector &c = vertices_[indices_[3 * i + 2]];
+            const STLVector u { b.x - a.x, b.y - a.y, b.z - a.z };
+            const STLVector v { c.x - a.x, c.y - a.y, c.z - a.z };
+            STLVector n { u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x };
+            const float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            if (length > 0) {
+                n = { n.x / length, n.y / length, n.z / length };
+            }
+            return { n, a, b, c };
+        }
+
+        /**
+         * @return ポリゴンの配列
+         */
+        [[nodiscard]]
+        std::vector<STLPolygon> to_polygons() const {
+            std::vector<STLPolygon> res(size());
+            for (std::size_t i = 0; i < res.size(); ++i) {
+                res[i] = polygon(i);
+            }
+            return res;
+        }
+
+        /**
+         * 辺の隣接関係を求めます
+         * @return 辺 3 * i + k (ポリゴン i の頂点 k から頂点 (k + 1) % 3 への辺) ごとの，逆向きに同じ頂点を結ぶ辺の番号．
+         * 無ければ npos
+         */
+        [[nodiscard]]
+        std::vector<std::uint32_t> adjacency() const {
+            std::vector<std::uint32_t> res(indices_.size(), npos);
+            std::unordered_map<std::uint64_t, std::uint32_t> edges; // 頂点の組から辺の番号
+            edges.reserve(indices_.size());
+            const auto key = [](const std::uint32_t from, const std::uint32_t to) {
+                return static_cast<std::uint64_t>(from) << 32 | to;
+            };
+            for (std::uint32_t e = 0; e < indices_.size(); ++e) {
+                const std::uint32_t from = indices_[e];
+                const std::uint32_t to = indices_[e % 3 == 2 ? e - 2 : e + 1];
+                const auto it = edges.find(key(to, from));
+                if (it != edges.end() && res[it->second] == npos) {
+                    res[it->second] = e;
+                    res[e] = it->second;
+                } else {
+                    edges.emplace(key(from, to), e);
+                }
+            }
+            return res;
+        }
+    };
+
+    namespace internal {
+
+        /**
+         * 頂点をまとめたメッシュを平面でスライスします
+         * @param mesh スライスの対象となるメッシュ
+         * @param plane 平面．GeneralPlane または AxisPlane
+         * @return スライスして得られた線分の配列
+         * @details 平面の式の値は頂点ごとに1回だけ計算します
+         */
+        template <class Plane>
+        static inline std::vector<STLSegment> slice_indexed_mesh(const STLIndexedMesh &mesh, const Plane &plane) {
+            STLUTIL_METRIC_SLICE();
+            const auto &vertices = mesh.vertices();
+            const auto &indices = mesh.indices();
+            STLUTIL_METRIC_COUNT(triangles_tested, indices.size() / 3);
+            std::vector<float> dist(vertices.size());
+            for (std::size_t i = 0; i < vertices.size(); ++i) {
+                dist[i] = plane(vertices[i]);
+            }
+            std::vector<STLSegment> res;
+            for (std::size_t i = 0; i < indices.size(); i += 3) {
+                const std::uint32_t p = indices[i], q = indices[i + 1], r = indices[i + 2];
+                if (may_cross_plane(dist[p], dist[q], dist[r])) {
+                    slice_triangle_at(vertices[p], vertices[q], vertices[r], dist[p], dist[q], dist[r], plane, res);
+                }
+            }
+            return res;
+        }
+    }
+
+    /**
+     * 頂点をまとめたメッシュを ax + by + cz + d = 0 で表される平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return スライスして得られた線分の配列
+     * @details 平面の式の値は頂点ごとに1回だけ計算します
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at(
+        const STLIndexedMesh &mesh,
+        const float a, const float b, const float c, const float d
+    ) {
+        return internal::slice_indexed_mesh(mesh, internal::GeneralPlane { a, b, c, d });
+    }
+
+    /**
+     * 頂点をまとめたメッシュをx軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param x スライスを行うx座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_x(
+        const STLIndexedMesh &mesh,
+        const float x
+    ) {
+        return internal::slice_indexed_mesh(mesh, internal::AxisPlane<STLAxis::x> { x });
+    }
+
+    /**
+     * 頂点をまとめたメッシュをy軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param y スライスを行うy座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_y(
+        const STLIndexedMesh &mesh,
+        const float y
+    ) {
+        return internal::slice_indexed_mesh(mesh, internal::AxisPlane<STLAxis::y> { y });
+    }
+
+    /**
+     * 頂点をまとめたメッシュをz軸に垂直な平面でスライスします
+     * @param mesh スライスの対象となるメッシュ
+     * @param z スライスを行うz座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_z(
+        const STLIndexedMesh &mesh,
+        const float z
+    ) {
+        return internal::slice_indexed_mesh(mesh, internal::AxisPlane<STLAxis::z> { z });
+    }
+
+    /**
+     * ポリゴンの配列を囲む最小の直方体を求めます
+     * @param polygons ポリゴンの配列
+     * @return ポリゴンの全頂点を含む直方体．ポリゴンが無ければ min が +inf, max が -inf になります
+     */
+    [[nodiscard]]
+    inline STLBoundingBox bounding_box(const std::vector<STLPolygon> &polygons) noexcept {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        STLBoundingBox box { { inf, inf, inf }, { -inf, -inf, -inf } };
+        for (const auto& [ ignore, a, b, c ] : polygons) {
+            for (const STLVector *v : { &a, &b, &c }) {
+                box.min = { std::min(box.min.x, v->x), std::min(box.min.y, v->y), std::min(box.min.z, v->z) };
+                box.max = { std::max(box.max.x, v->x), std::max(box.max.y, v->y), std::max(box.max.z, v->z) };
+            }
+        }
+        return box;
+    }
+
+    /**
+     * xy平面上の占有格子地図を表す構造体
+     * @details セル (i, j) は [origin_x + i * resolution, origin_x + (i + 1) * resolution) × [origin_y + j * resolution, ...) の範囲を表し，
+     * data[j * width + i] に格納されます．値は 0 が空き，1 が占有です
+     */
+    struct STLOccupancyGrid {
+        float origin_x; // セル (0, 0) の左下の角のx座標
+        float origin_y; // セル (0, 0) の左下の角のy座標
+        float resolution; // セルの一辺の長さ
+        std::size_t width; // x方向のセルの数
+        std::size_t height; // y方向のセルの数
+        std::vector<std::uint8_t> data; // セルの値の配列
+    };
+
+    namespace internal {
+
+        /**
+         * スライスして得られた線分を占有格子地図に直接書き込むための push_back を提供します
+         * @details data の最下位ビットに線分が通るセル，その次のビットに偶奇判定用の反転位置を記録します
+         */
+        struct RasterSink {
+            STLOccupancyGrid &grid; // 書き込み先
+            bool fill; // 内部を塗りつぶすかどうか
+
+            void push_back(const STLSegment &segment) {
+                const float x0 = (segment.p.x - grid.origin_x) / grid.resolution;
+                const float y0 = (segment.p.y - grid.origin_y) / grid.resolution;
+                const float x1 = (segment.q.x - grid.origin_x) / grid.resolution;
+                const float y1 = (segment.q.y - grid.origin_y) / grid.resolution;
+                draw(x0, y0, x1, y1);
+                if (fill) {
+                    toggle(x0, y0, x1, y1);
+                }
+            }
+
+            /**
+             * 線分が通る全てのセルを占有にします
+             * @details 格子の範囲に切り取った後，格子の境界を越えるごとに1セルずつ進みます
+             */
+            void draw(float x0, float y0, float x1, float y1) {
+                const auto w = static_cast<float>(grid.width), h = static_cast<float>(grid.height);
+                // Liang-Barsky法で [0, w] × [0, h] に切り取る
+                float t0 = 0, t1 = 1;
+                const float dx = x1 - x0, dy = y1 - y0;
+                const float p[4] = { -dx, dx, -dy, dy };
+                const float q[4] = { x0, w - x0, y0, h - y0 };
+                for (int k = 0; k < 4; ++k) {
+                    if (p[k] == 0) {
+                        if (q[k] < 0) {
+                            return;
+                        }
+                    } else {
+                        const float t = q[k] / p[k];
+                        if (p[k] < 0) {
+                            t0 = std::max(t0, t);
+                        } else {
+                            t1 = std::min(t1, t);
+                        }
+                    }
+                }
+                if (t0 > t1) {
+                    return;
+                }
+                const float sx = x0 + t0 * dx, sy = y0 + t0 * dy;
+                const float ex = x0 + t1 * dx, ey = y0 + t1 * dy;
+                const auto cell = [](const float v, const std::size_t n) {
+                    return static_cast<std::int64_t>(std::clamp(std::floor(v), 0.0f, static_cast<float>(n - 1)));
+                };
+                std::int64_t i = cell(sx, grid.width), j = cell(sy, grid.height);
+                const std::int64_t ie = cell(ex, grid.width), je = cell(ey, grid.height);
+                const std::int64_t step_i = dx > 0 ? 1 : -1, step_j = dy > 0 ? 1 : -1;
+                // 次にx, yそれぞれの方向のセルの境界を越えるときの媒介変数の値と，その間隔
+                constexpr float inf = std::numeric_limits<float>::infinity();
+                float next_x = inf, next_y = inf, delta_x = inf, delta_y = inf;
+                if (dx != 0) {
+                    next_x = (static_cast<float>(step_i > 0 ? i + 1 : i) - sx) / dx;
+                    delta_x = std::abs(1 / dx);
+                }
+                if (dy != 0) {
+                    next_y = (static_cast<float>(step_j > 0 ? j + 1 : j) - sy) / dy;
+                    delta_y = std::abs(1 / dy);
+                }
+                grid.data[static_cast<std::size_t>(j) * grid.width + static_cast<std::size_t>(i)] |= 1;
+                for (std::int64_t n = std::abs(ie - i) + std::abs(je - j); n > 0; --n) {
+                    if ((next_x < next_y && i != ie) || j == je) {
+                        i += step_i;
+                        next_x += delta_x;
+                    } else {
+                        j += step_j;
+                        next_y += delta_y;
+                    }
+                    grid.data[static_cast<std::size_t>(j) * grid.width + static_cast<std::size_t>(i)] |= 1;
+                }
+            }
+
+            /**
+             * 線分がセルの中心を通る水平線と交わる位置に，偶奇判定の反転位置を記録します
+             * @details 交差は y の半開区間で判定するので，線分の端点を共有する線分で二重に数えません
+             */
+            void toggle(float x0, float y0, float x1, float y1) {
+                if (y0 == y1) {
+                    return;
+                }
+                if (y0 > y1) {
+                    std::swap(x0, x1);
+                    std::swap(y0, y1);
+                }
+                const auto h = static_cast<float>(grid.height);
+                const float first = std::max(std::ceil(y0 - 0.5f), 0.0f);
+                const float last = std::min(std::ceil(y1 - 0.5f), h);
+                const float slope = (x1 - x0) / (y1 - y0);
+                for (float row = first; row < last; ++row) {
+                    const float x = x0 + (row + 0.5f - y0) * slope;
+                    const float column = std::max(std::floor(x - 0.5f) + 1, 0.0f);
+                    if (column < static_cast<float>(grid.width)) {
+                        grid.data[static_cast<std::size_t>(row) * grid.width + static_cast<std::size_t>(column)] ^= 2;
+                    }
+                }
+            }
+
+            /**
+             * 反転位置から偶奇判定を行ない，セルの値を 0 または 1 にします
+             */
+            void finish() {
+                for (std::size_t j = 0; j < grid.height; ++j) {
+                    std::uint8_t inside = 0;
+                    std::uint8_t *row = grid.data.data() + j * grid.width;
+                    for (std::size_t i = 0; i < grid.width; ++i) {
+                        inside ^= static_cast<std::uint8_t>(row[i] >> 1);
+                        row[i] = static_cast<std::uint8_t>((row[i] | inside) & 1);
+                    }
+                }
+            }
+        };
+    }
+
+    /**
+     * ポリゴンをz軸に垂直な平面でスライスした断面を占有格子地図に直接書き込みます
+     * @param polygons スライスの対象となるポリゴンの配列
+     * @param z スライスを行うz座標
+     * @param resolution セルの一辺の長さ
+     * @param bounds 地図にするxy平面上の範囲．z座標は使いません
+     * @param fill trueなら断面の内部を偶奇判定で塗りつぶします
+     * @return 占有格子地図．線分が通るセルと，fill の場合は内部のセルが占有になります
+     * @details 線分の配列を作らずに，スライスと同時に書き込みます
+     */
+    [[nodiscard]]
+    inline STLOccupancyGrid rasterize_slice(
+        const std::vector<STLPolygon> &polygons,
+        const float z,
+        const float resolution,
+        const STLBoundingBox &bounds,
+        const bool fill = false
+    ) {
+        STLOccupancyGrid grid { bounds.min.x, bounds.min.y, resolution, 0, 0, {} };
+        if (!(resolution > 0) || !(bounds.max.x > bounds.min.x) || !(bounds.max.y > bounds.min.y)) {
+            return grid;
+        }
+        grid.width = static_cast<std::size_t>(std::ceil((bounds.max.x - bounds.min.x) / resolution));
+        grid.height = static_cast<std::size_t>(std::ceil((bounds.max.y - bounds.min.y) / resolution));
+        grid.data.assign(grid.width * grid.height, 0);
+        internal::RasterSink sink { grid, fill };
+        internal::slice_polygons(polygons.data(), polygons.size(), internal::AxisPlane<STLAxis::z> { z }, sink);
+        if (fill) {
+            sink.finish();
+        }
+        return grid;
+    }
+
+    namespace internal {
+
+        constexpr char cache_magic[8] = { 'S', 'T', 'L', 'U', 'C', 'A', 'C', 'H' }; // キャッシュファイルの識別子
+        constexpr std::uint32_t cache_version = 1; // キャッシュファイルの形式のバージョン
+        constexpr std::uint32_t cache_endian = 0x01020304; // バイト順の確認用の値
+        constexpr std::size_t cache_alignment = 64; // 各セクションの先頭の境界 [byte]
+
+        /**
+         * キャッシュファイルのヘッダ
+         * @details 値は書き込んだ環境のバイト順で格納されます
+         */
+        struct CacheHeader {
+            char magic[8]; // 識別子
+            std::uint32_t version; // 形式のバージョン
+            std::uint32_t endian; // バイト順の確認用の値
+            std::uint64_t vertex_count; // 頂点の数
+            std::uint64_t triangle_count; // ポリゴンの数
+            std::uint64_t bucket_count; // 索引のバケットの数
+            std::uint64_t vertices_offset; // 頂点の配列の位置
+            std::uint64_t indices_offset; // 添字の配列の位置
+            std::uint64_t min_z_offset; // ポリゴンごとのz座標の最小値の配列の位置
+            std::uint64_t max_z_offset; // ポリゴンごとのz座標の最大値の配列の位置
+            std::uint64_t buckets_offset; // バケットの配列の位置
+            STLBoundingBox bounds; // メッシュ全体を囲む直方体
+            char reserved[128 - 80 - sizeof(STLBoundingBox)]; // 予約領域
+        };
+
+        static_assert(sizeof(CacheHeader) == 128 && std::is_trivially_copyable_v<CacheHeader>);
+        static_assert(sizeof(SliceIndexBucket) == 16 && std::is_trivially_copyable_v<SliceIndexBucket>);
+
+        /**
+         * @param offset 位置 [byte]
+         * @return offset 以上で最小の cache_alignment の倍数
+         */
+        [[nodiscard]]
+        static inline std::uint64_t cache_align(const std::uint64_t offset) noexcept {
+            return (offset + cache_alignment - 1) / cache_alignment * cache_alignment;
+        }
+    }
+
+    /**
+     * 頂点をまとめたメッシュとスライス用の索引をファイルに保存します
+     * @param path 保存先のパス
+     * @param polygons 保存するポリゴンの配列
+     * @param weld_epsilon 同一とみなす頂点の距離
+     * @return 保存に成功したらtrue
+     * @details 保存したファイルは STLMapCache でメモリにマップするだけで，索引を作り直さずにスライスに使えます．
+     * 値は保存した環境のバイト順で格納するので，バイト順の異なる環境では読み込めません
+     */
+    inline bool save_cache(
+        const std::string &path,
+        const std::vector<STLPolygon> &polygons,
+        const float weld_epsilon = 0
+    ) {
+        // 頂点をまとめた後の座標で索引を作り，索引の順に添字を振り直す
+        const STLSliceIndex index(weld_epsilon == 0 ? polygons : STLIndexedMesh(polygons, weld_epsilon).to_polygons());
+        const STLIndexedMesh mesh(index.polygons());
+
+        internal::CacheHeader header {};
+        std::memcpy(header.magic, internal::cache_magic, sizeof(header.magic));
+        header.version = internal::cache_version;
+        header.endian = internal::cache_endian;
+        header.vertex_count = mesh.vertices().size();
+        header.triangle_count = mesh.size();
+        header.bucket_count = index.buckets().size();
+        header.vertices_offset = internal::cache_align(sizeof(header));
+        header.indices_offset = internal::cache_align(header.vertices_offset + header.vertex_count * sizeof(STLVector));
+        header.min_z_offset = internal::cache_align(header.indices_offset + header.triangle_count * 3 * sizeof(std::uint32_t));
+        header.max_z_offset = internal::cache_align(header.min_z_offset + header.triangle_count * sizeof(float));
+        header.buckets_offset = internal::cache_align(header.max_z_offset + header.triangle_count * sizeof(float));
+        header.bounds = bounding_box(index.polygons());
+
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "stlutil::save_cache() Error: Cannot open file `" << path << "`." << std::endl;
+            return false;
+        }
+        std::uint64_t written = 0;
+        const auto write = [&file, &written](const std::uint64_t offset, const void *data, const std::uint64_t size) {
+            static const char zeros[internal::cache_alignment] = {};
+            file.write(zeros, static_cast<std::streamsize>(offset - written));
+            file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            written = offset + size;
+        };
+        write(0, &header, sizeof(header));
+        write(header.vertices_offset, mesh.vertices().data(), header.vertex_count * sizeof(STLVector));
+        write(header.indices_offset, mesh.indices().data(), header.triangle_count * 3 * sizeof(std::uint32_t));
+        write(header.min_z_offset, index.min_z().data(), header.triangle_count * sizeof(float));
+        write(header.max_z_offset, index.max_z().data(), header.triangle_count * sizeof(float));
+        write(header.buckets_offset, index.buckets().data(), header.bucket_count * sizeof(internal::SliceIndexBucket));
+        if (!file.flush()) {
+            std::cerr << "stlutil::save_cache() Error: Cannot write file `" << path << "`." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * save_cache で保存したファイルをメモリにマップして参照する構造体
+     * @details ファイルの内容をそのまま参照します．開く際にバケットと頂点の添字が範囲内にあることを確認するので，
+     * 壊れたファイルでスライスしても範囲外を参照しません．添字の確認を省くと読み込みにかかる時間はファイルの大きさにほとんどよりませんが，
+     * その場合はファイルの内容を信用できる場合に限ります
+     */
+    struct STLMapCache {
+    private:
+        internal::MappedFile file_; // マップしたファイル
+        internal::CacheHeader header_ {}; // ファイルのヘッダ
+        const STLVector *vertices_ = nullptr; // 頂点の配列
+        const std::uint32_t *indices_ = nullptr; // ポリゴンごとの3頂点の添字の配列
+        const float *min_z_ = nullptr; // ポリゴンごとのz座標の最小値の配列
+        const float *max_z_ = nullptr; // ポリゴンごとのz座標の最大値の配列
+        const internal::SliceIndexBucket *buckets_ = nullptr; // バケットの配列
+
+        bool valid = false; // 読み取りが正常に行えたかどうか
+
+        /**
+         * ヘッダの内容がファイルの大きさと矛盾していないかを確認します
+         * @return 矛盾が無ければtrue
+         */
+        [[nodiscard]]
+        bool check_layout() const noexcept {
+            const std::uint64_t size = file_.size();
+            const auto fits = [size](const std::uint64_t offset, const std::uint64_t count, const std::uint64_t element) {
+                return offset % internal::cache_alignment == 0 && offset <= size
+                    && count <= (size - offset) / element;
+            };
+            return header_.vertex_count <= std::numeric_limits<std::uint32_t>::max()
+                && fits(header_.vertices_offset, header_.vertex_count, sizeof(STLVector))
+                && fits(header_.indices_offset, header_.triangle_count, 3 * sizeof(std::uint32_t))
+                && fits(header_.min_z_offset, header_.triangle_count, sizeof(float))
+                && fits(header_.max_z_offset, header_.triangle_count, sizeof(float))
+                && fits(header_.buckets_offset, header_.bucket_count, sizeof(internal::SliceIndexBucket));
+        }
+
+        /**
+         * バケットが範囲内にあり min_z の昇順に並んでいるかを確認します
+         * @return 矛盾が無ければtrue
+         * @details バケットの数はポリゴンの数の平方根程度なので，開くたびに確認します
+         */
+        [[nodiscard]]
+        bool check_buckets() const noexcept {
+            const std::uint64_t count = header_.triangle_count;
+            for (std::uint64_t k = 0; k < header_.bucket_count; ++k) {
+                const internal::SliceIndexBucket &bucket = buckets_[k];
+                if (bucket.begin > bucket.end || bucket.end > count) {
+                    return false;
+                }
+                // NaN も並んでいないものとして扱う
+                if (k > 0 && !(buckets_[k - 1].min_z <= bucket.min_z)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * 頂点の添字が全て頂点の数より小さいかを確認します
+         * @return 矛盾が無ければtrue
+         */
+        [[nodiscard]]
+        bool check_indices() const noexcept {
+            const std::uint64_t count = header_.triangle_count * 3;
+            const std::uint64_t vertices = header_.vertex_count;
+            return std::all_of(indices_, indices_ + count, [vertices](const std::uint32_t index) {
+                return index < vertices;
+            });
+        }
+
+    public:
+        STLMapCache(const STLMapCache&) = delete;
+        STLMapCache &operator=(const STLMapCache&) = delete;
+
+        /**
+         * キャッシュファイルをメモリにマップします
+         * @param path 読み込むキャッシュファイルへのパス
+         * @param verify_indices 頂点の添字が範囲内にあることを確認するかどうか．false にするのは信用できるファイルに限ります
+         */
+        explicit STLMapCache(const std::string &path, const bool verify_indices = true) : file_(path) {
+            if (!file_.is_open()) {
+                std::cerr << "STLMapCache::STLMapCache() Error: Cannot open file `" << path << "`." << std::endl;
+                return;
+            }
+            if (file_.size() < sizeof(header_)) {
+                std::cerr << "STLMapCache::STLMapCache() Error: File `" << path << "` is too small." << std::endl;
+                return;
+            }
+            std::memcpy(&header_, file_.data(), sizeof(header_));
+            if (std::memcmp(header_.magic, internal::cache_magic, sizeof(header_.magic)) != 0
+                || header_.version != internal::cache_version || header_.endian != internal::cache_endian) {
+                std::cerr << "STLMapCache::STLMapCache() Error: File `" << path << "` is not a compatible cache." << std::endl;
+                return;
+            }
+            if (!check_layout()) {
+                std::cerr << "STLMapCache::STLMapCache() Error: File `" << path << "` is corrupted." << std::endl;
+                return;
+            }
+            const char *base = file_.data();
+            vertices_ = reinterpret_cast<const STLVector *>(base + header_.vertices_offset);
+            indices_ = reinterpret_cast<const std::uint32_t *>(base + header_.indices_offset);
+            min_z_ = reinterpret_cast<const float *>(base + header_.min_z_offset);
+            max_z_ = reinterpret_cast<const float *>(base + header_.max_z_offset);
+            buckets_ = reinterpret_cast<const internal::SliceIndexBucket *>(base + header_.buckets_offset);
+            if (!check_buckets() || (verify_indices && !check_indices())) {
+                std::cerr << "STLMapCache::STLMapCache() Error: File `" << path << "` is corrupted." << std::endl;
+                vertices_ = nullptr;
+                indices_ = nullptr;
+                min_z_ = nullptr;
+                max_z_ = nullptr;
+                buckets_ = nullptr;
+                header_ = {};
+                return;
+            }
+            valid = true;
+        }
+
+        STLMapCache(STLMapCache &&other) noexcept
+            : file_(std::move(other.file_)), header_(other.header_),
+              vertices_(std::exchange(other.vertices_, nullptr)), indices_(std::exchange(other.indices_, nullptr)),
+              min_z_(std::exchange(other.min_z_, nullptr)), max_z_(std::exchange(other.max_z_, nullptr)),
+              buckets_(std::exchange(other.buckets_, nullptr)), valid(std::exchange(other.valid, false)) {
+            other.header_ = {};
+        }
+
+        /**
+         * @return 読み取りが正常に行えていたらtrue，そうでなければfalse
+         */
+        explicit operator bool() const noexcept {
+            return valid;
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return static_cast<std::size_t>(header_.triangle_count);
+        }
+
+        /**
+         * @return 頂点の数
+         */
+        [[nodiscard]]
+        std::size_t vertex_count() const noexcept {
+            return static_cast<std::size_t>(header_.vertex_count);
+        }
+
+        /**
+         * @return 頂点の配列の先頭へのポインタ
+         */
+        [[nodiscard]]
+        const STLVector *vertices() const noexcept {
+            return vertices_;
+        }
+
+        /**
+         * @return ポリゴンごとの3頂点の添字の配列の先頭へのポインタ
+         */
+        [[nodiscard]]
+        const std::uint32_t *indices() const noexcept {
+            return indices_;
+        }
+
+        /**
+         * @return メッシュ全体を囲む直方体
+         */
+        [[nodiscard]]
+        const STLBoundingBox &bounds() const noexcept {
+            return header_.bounds;
+        }
+
+        /**
+         * @param i ポリゴンの番号
+         * @return i番目のポリゴン．法線ベクトルは0です
+         */
+        [[nodiscard]]
+        STLPolygon polygon(const std::size_t i) const noexcept {
+            return {
+                { 0, 0, 0 },
+                vertices_[indices_[3 * i]], vertices_[indices_[3 * i + 1]], vertices_[indices_[3 * i + 2]]
+            };
+        }
+
+        /**
+         * 平面 z = const と交わり得るポリゴンを列挙します
+         * @param z スライスを行うz座標
+         * @param f ポリゴンの番号を受け取る関数
+         */
+        template <class F>
+        void for_each_candidate(const float z, F &&f) const {
+            internal::for_each_slice_candidate(
+                buckets_, static_cast<std::size_t>(header_.bucket_count), min_z_, max_z_, z, std::forward<F>(f)
+            );
+        }
+
+        /**
+         * ポリゴンをz軸に垂直な平面でスライスします
+         * @param z スライスを行うz座標
+         * @return スライスして得られた線分の配列
+         */
+        [[nodiscard]]
+        std::vector<STLSegment> slice_at_z(const float z) const {
+            STLUTIL_METRIC_SLICE();
+            std::vector<STLSegment> res;
+            for_each_candidate(z, [this, &res, z](const std::size_t i) {
+                const STLVector &p = vertices_[indices_[3 * i]];
+                const STLVector &q = vertices_[indices_[3 * i + 1]];
+                const STLVector &r = vertices_[indices_[3 * i + 2]];
+                internal::slice_triangle(p, q, r, internal::AxisPlane<STLAxis::z> { z }, res);
+            });
+            return res;
+        }
+    };
+
+    /**
+     * save_cache で保存したファイルを読み込みます
+     * @param path 読み込むキャッシュファイルへのパス
+     * @param verify_indices 頂点の添字が範囲内にあることを確認するかどうか．false にするのは信用できるファイルに限ります
+     * @return メモリにマップしたキャッシュ．失敗した場合は operator bool が false を返します
+     */
+    [[nodiscard]]
+    inline STLMapCache load_cache(const std::string &path, const bool verify_indices = true) {
+        return STLMapCache(path, verify_indices);
+    }
+
+    /**
+     * キャッシュを使ってポリゴンをz軸に垂直な平面でスライスします
+     * @param cache スライスの対象となるキャッシュ
+     * @param z スライスを行うz座標
+     * @return スライスして得られた線分の配列
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at_z(
+        const STLMapCache &cache,
+        const float z
+    ) {
+        return cache.slice_at_z(z);
+    }
+
+    /**
+     * 半直線を表す構造体
+     * @details 点 origin + t * direction (t >= 0) の集合を表します
+     */
+    struct STLRay {
+        STLVector origin; // 始点
+        STLVector direction; // 向き．正規化されている必要はありません
+    };
+
+    /**
+     * 半直線とポリゴンの交点を表す構造体
+     */
+    struct STLRayHit {
+        float t = std::numeric_limits<float>::infinity(); // 始点から交点までの距離．direction の長さを単位とします
+        std::uint32_t index = std::numeric_limits<std::uint32_t>::max(); // 交わったポリゴンの元の配列での番号
+        float u = 0; // 交点の重心座標のうち，2番目の頂点の重み
+        float v = 0; // 交点の重心座標のうち，3番目の頂点の重み
+
+        /**
+         * @return ポリゴンと交わっていればtrue
+         */
+        explicit operator bool() const noexcept {
+            return index != std::numeric_limits<std::uint32_t>::max();
+        }
+    };
+
+    namespace internal {
+
+        constexpr std::size_t bvh_bins = 16; // SAHの評価に使う区間の数
+        constexpr std::size_t bvh_max_depth = 48; // 木の深さの上限
+        constexpr std::size_t bvh_min_rays = 1024; // 並列処理で1スレッドに割り当てる最小の半直線の数
+
+        /**
+         * STLBVH の節点
+         * @details count が0なら内部節点で，子は nodes[offset] と nodes[offset + 1] です．
+         * そうでなければ葉で，polygons[offset] から count 個のポリゴンを持ちます
+         */
+        struct BVHNode {
+            STLBoundingBox box; // 節点に含まれるポリゴンを囲む直方体
+            std::uint32_t offset; // 子の番号，または先頭のポリゴンの番号
+            std::uint32_t count; // 葉に含まれるポリゴンの数
+        };
+
+        static_assert(sizeof(BVHNode) == 32);
+
+        /**
+         * @param box 直方体
+         * @return 直方体の表面積の半分
+         */
+        [[nodiscard]]
+        static inline float half_area(const STLBoundingBox &box) noexcept {
+            const float dx = box.max.x - box.min.x, dy = box.max.y - box.min.y, dz = box.max.z - box.min.z;
+            return dx * dy + dy * dz + dz * dx;
+        }
+
+        /**
+         * @param box 広げる直方体
+         * @param other 含める直方体
+         */
+        static inline void expand(STLBoundingBox &box, const STLBoundingBox &other) noexcept {
+            box.min = { std::min(box.min.x, other.min.x), std::min(box.min.y, other.min.y), std::min(box.min.z, other.min.z) };
+            box.max = { std::max(box.max.x, other.max.x), std::max(box.max.y, other.max.y), std::max(box.max.z, other.max.z) };
+        }
+
+        /**
+         * @param v ベクトル
+         * @param axis 成分の番号 (0: x, 1: y, 2: z)
+         * @return v の axis 番目の成分
+         */
+        [[nodiscard]]
+        static inline float component(const STLVector &v, const std::size_t axis) noexcept {
+            return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+        }
+
+        /**
+         * 半直線と直方体が交わる範囲を求めます
+         * @param box 直方体
+         * @param origin 半直線の始点
+         * @param inv 半直線の向きの各成分の逆数
+         * @param t_max 調べる距離の上限
+         * @return 交わる範囲の始まり．交わらなければ +inf
+         * @details NaN になった成分は範囲を狭めないものとして扱います
+         */
+        [[nodiscard]]
+        static inline float ray_box_entry(
+            const STLBoundingBox &box, const STLVector &origin, const STLVector &inv, const float t_max
+        ) noexcept {
+            float t_near = 0, t_far = t_max;
+            const float t[3][2] = {
+                { (box.min.x - origin.x) * inv.x, (box.max.x - origin.x) * inv.x },
+                { (box.min.y - origin.y) * inv.y, (box.max.y - origin.y) * inv.y },
+                { (box.min.z - origin.z) * inv.z, (box.max.z - origin.z) * inv.z }
+            };
+            for (const auto &[ t0, t1 ] : t) {
+                const float lo = t0 < t1 ? t0 : t1, hi = t0 < t1 ? t1 : t0;
+                t_near = lo > t_near ? lo : t_near;
+                t_far = hi < t_far ? hi : t_far;
+            }
+            return t_near <= t_far ? t_near : std::numeric_limits<float>::infinity();
+        }
+
+        /**
+         * 半直線とポリゴンの交点を Möller–Trumbore 法で求めます
+         * @param polygon ポリゴン
+         * @param ray 半直線
+         * @param t_max 調べる距離の上限
+         * @param hit 交点の格納先．t_max より近い交点が見つかった場合だけ t, u, v を書き換えます
+         * @return 交点が見つかったらtrue
+         * @details 裏面とも交わります
+         */
+        static inline bool intersect_ray(
+            const STLPolygon &polygon, const STLRay &ray, const float t_max, STLRayHit &hit
+        ) noexcept {
+            const auto &[ ignore, a, b, c ] = polygon;
+            const STLVector e1 = { b.x - a.x, b.y - a.y, b.z - a.z }, e2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+            const STLVector &dir = ray.direction;
+            const STLVector p = { dir.y * e2.z - dir.z * e2.y, dir.z * e2.x - dir.x * e2.z, dir.x * e2.y - dir.y * e2.x };
+            const float det = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+            if (!(det != 0)) {
+                return false;
+            }
+            const float inv_det = 1 / det;
+            const STLVector s = { ray.origin.x - a.x, ray.origin.y - a.y, ray.origin.z - a.z };
+            const float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inv_det;
+            if (!(u >= 0 && u <= 1)) {
+                return false;
+            }
+            const STLVector q = { s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x };
+            const float v = (dir.x * q.x + dir.y * q.y + dir.z * q.z) * inv_det;
+            if (!(v >= 0 && u + v <= 1)) {
+                return false;
+            }
+            const float t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inv_det;
+            if (!(t >= 0 && t < t_max)) {
+                return false;
+            }
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            return true;
+        }
+    }
+
+    /**
+     * ポリゴンの包含箱の階層 (BVH) を保持する構造体
+     * @details SAHで分割した木を配列に平坦化して持ちます．ポリゴンは葉の順に並べ替えて保持するので，
+     * 近くのポリゴンがメモリ上でも近くに並びます
+     */
+    struct STLBVH {
+    private:
+        std::vector<STLPolygon> polygons_; // 葉の順に並べ替えたポリゴンの配列
+        std::vector<std::uint32_t> indices_; // 並べ替えたポリゴンそれぞれの，元の配列での番号
+        std::vector<internal::BVHNode> nodes_; // 節点の配列．nodes_[0] が根
+
+        /**
+         * 木を構築します
+         * @param polygons 元のポリゴンの配列
+         * @param leaf_size 葉に含めるポリゴンの数の目安
+         * @param bounds 読み込み時に求めたポリゴンごとの包含箱．nullptrなら頂点から求める
+         */
+        void build(const std::vector<STLPolygon> &polygons, const std::size_t leaf_size, const STLPolygonBounds *bounds = nullptr) {
+            const std::size_t n = polygons.size();
+            std::vector<STLBoundingBox> boxes(n);
+            std::vector<STLVector> centroids(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                if (bounds != nullptr) {
+                    boxes[i] = bounds->box(i);
+                } else {
+                    const auto &[ ignore, a, b, c ] = polygons[i];
+                    boxes[i] = {
+                        { std::min({ a.x, b.x, c.x }), std::min({ a.y, b.y, c.y }), std::min({ a.z, b.z, c.z }) },
+                        { std::max({ a.x, b.x, c.x }), std::max({ a.y, b.y, c.y }), std::max({ a.z, b.z, c.z }) }
+                    };
+                }
+                centroids[i] = {
+                    (boxes[i].min.x + boxes[i].max.x) * 0.5f,
+                    (boxes[i].min.y + boxes[i].max.y) * 0.5f,
+                    (boxes[i].min.z + boxes[i].max.z) * 0.5f
+                };
+            }
+            indices_.resize(n);
+            std::iota(indices_.begin(), indices_.end(), 0u);
+
+            struct Task {
+                std::uint32_t node, begin, end, depth;
+            };
+            constexpr float inf = std::numeric_limits<float>::infinity();
+            const STLBoundingBox empty { { inf, inf, inf }, { -inf, -inf, -inf } };
+
+            nodes_.reserve(n == 0 ? 1 : 2 * n / std::max<std::size_t>(leaf_size, 1) + 1);
+            nodes_.push_back({ empty, 0, 0 });
+            std::vector<Task> tasks { { 0, 0, static_cast<std::uint32_t>(n), 0 } };
+            while (!tasks.empty()) {
+                const Task task = tasks.back();
+                tasks.pop_back();
+                const std::size_t count = task.end - task.begin;
+
+                STLBoundingBox box = empty, centroid_box = empty;
+                for (std::size_t i = task.begin; i < task.end; ++i) {
+                    internal::expand(box, boxes[indices_[i]]);
+                    internal::expand(centroid_box, { centroids[indices_[i]], centroids[indices_[i]] });
+                }
+                nodes_[task.node] = { box, task.begin, static_cast<std::uint32_t>(count) };
+                if (count <= leaf_size || task.depth >= internal::bvh_max_depth) {
+                    continue;
+                }
+
+                // 重心の範囲を等分した区間ごとに集計し，表面積の和が最小になる分割を選ぶ
+                float best_cost = static_cast<float>(count);
+                std::size_t best_axis = 0, best_split = 0;
+                for (std::size_t axis = 0; axis < 3; ++axis) {
+                    const float lo = internal::component(centroid_box.min, axis);
+                    const float extent = internal::component(centroid_box.max, axis) - lo;
+                    if (!(extent > 0)) {
+                        continue;
+                    }
+                    const float scale = internal::bvh_bins / extent;
+                    STLBoundingBox bin_boxes[internal::bvh_bins];
+                    std::size_t bin_counts[internal::bvh_bins] = {};
+                    std::fill(std::begin(bin_boxes), std::end(bin_boxes), empty);
+                    for (std::size_t i = task.begin; i < task.end; ++i) {
+                        const float f = (internal::component(centroids[indices_[i]], axis) - lo) * scale;
+                        const std::size_t bin = f > 0 ? std::min(static_cast<std::size_t>(f), internal::bvh_bins - 1) : 0;
+                        internal::expand(bin_boxes[bin], boxes[indices_[i]]);
+                        ++bin_counts[bin];
+                    }
+                    float right_area[internal::bvh_bins];
+                    STLBoundingBox right = empty;
+                    for (std::size_t bin = internal::bvh_bins - 1; bin > 0; --bin) {
+                        internal::expand(right, bin_boxes[bin]);
+                        right_area[bin] = internal::half_area(right);
+                    }
+                    STLBoundingBox left = empty;
+                    std::size_t left_count = 0;
+                    const float parent_area = internal::half_area(box);
+                    for (std::size_t split = 1; split < internal::bvh_bins; ++split) {
+                        internal::expand(left, bin_boxes[split - 1]);
+                        left_count += bin_counts[split - 1];
+                        const std::size_t right_count = count - left_count;
+                        if (left_count == 0 || right_count == 0) {
+                            continue;
+                        }
+                        const float cost = 1 + (internal::half_area(left) * static_cast<float>(left_count) + right_area[split] * static_cast<float>(right_count)) / parent_area;
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_split = split;
+                        }
+                    }
+                }
+                if (best_split == 0) {
+                    continue;
+                }
+
+                const float lo = internal::component(centroid_box.min, best_axis);
+                const float scale = internal::bvh_bins / (internal::component(centroid_box.max, best_axis) - lo);
+                const auto middle = std::partition(indices_.begin() + task.begin, indices_.begin() + task.end, [&](const std::uint32_t i) {
+                    const float f = (internal::component(centroids[i], best_axis) - lo) * scale;
+                    return (f > 0 ? std::min(static_cast<std::size_t>(f), internal::bvh_bins - 1) : 0) < best_split;
+                });
+                const auto mid = static_cast<std::uint32_t>(middle - indices_.begin());
+                const auto child = static_cast<std::uint32_t>(nodes_.size());
+                nodes_[task.node].offset = child;
+                nodes_[task.node].count = 0;
+                nodes_.push_back({ empty, 0, 0 });
+                nodes_.push_back({ empty, 0, 0 });
+                tasks.push_back({ child + 1, mid, task.end, task.depth + 1 });
+                tasks.push_back({ child, task.begin, mid, task.depth + 1 });
+            }
+
+            polygons_.resize(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                polygons_[i] = polygons[indices_[i]];
+            }
+        }
+
+    public:
+        /**
+         * ポリゴンの配列から木を構築します
+         * @param polygons 対象となるポリゴンの配列
+         * @param leaf_size 葉に含めるポリゴンの数の目安
+         */
+        explicit STLBVH(const std::vector<STLPolygon> &polygons, const std::size_t leaf_size = 4) {
+            build(polygons, leaf_size);
+        }
+
+        /**
+         * 読み込んだSTLファイルのポリゴンから木を構築します
+         * @param reader 読み込み済みの STLReader
+         * @param leaf_size 葉に含めるポリゴンの数の目安
+         * @details 読み込み時に包含箱を求めていれば，それを使います
+         */
+        explicit STLBVH(const STLReader &reader, const std::size_t leaf_size = 4) {
+            const auto &bounds = reader.polygon_bounds();
+            build(reader.polygons(), leaf_size, bounds.size() == reader.polygons().size() ? &bounds : nullptr);
+        }
+
+        /**
+         * 半直線と最も近くで交わるポリゴンを求めます
+         * @param ray 半直線
+         * @param t_max 調べる距離の上限．direction の長さを単位とします
+         * @return 交点．交わるポリゴンが無ければ operator bool が false を返します
+         */
+        [[nodiscard]]
+        STLRayHit raycast(const STLRay &ray, const float t_max = std::numeric_limits<float>::infinity()) const noexcept {
+            STLRayHit hit;
+            hit.t = t_max;
+            if (polygons_.empty()) {
+                return hit;
+            }
+            const STLVector inv = { 1 / ray.direction.x, 1 / ray.direction.y, 1 / ray.direction.z };
+            // 節点の番号と，その節点に入る距離の組を積む
+            std::uint32_t stack[internal::bvh_max_depth + 1];
+            float entry[internal::bvh_max_depth + 1];
+            std::size_t top = 0;
+            stack[top] = 0;
+            entry[top++] = internal::ray_box_entry(nodes_[0].box, ray.origin, inv, hit.t);
+            while (top > 0) {
+                --top;
+                if (!(entry[top] < hit.t)) {
+                    continue;
+                }
+                const internal::BVHNode &node = nodes_[stack[top]];
+                if (node.count > 0) {
+                    for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                        if (internal::intersect_ray(polygons_[i], ray, hit.t, hit)) {
+                            hit.index = indices_[i];
+                        }
+                    }
+                    continue;
+                }
+                // 近い方の子を先に調べ，既に見つかった交点より遠い子は調べない
+                std::uint32_t near = node.offset, far = node.offset + 1;
+                float t_near = internal::ray_box_entry(nodes_[near].box, ray.origin, inv, hit.t);
+                float t_far = internal::ray_box_entry(nodes_[far].box, ray.origin, inv, hit.t);
+                if (t_far < t_near) {
+                    std::swap(near, far);
+                    std::swap(t_near, t_far);
+                }
+                if (t_far < hit.t) {
+                    stack[top] = far;
+                    entry[top++] = t_far;
+                }
+                if (t_near < hit.t) {
+                    stack[top] = near;
+                    entry[top++] = t_near;
+                }
+            }
+            if (!hit) {
+                hit.t = std::numeric_limits<float>::infinity();
+            }
+            return hit;
+        }
+
+        /**
+         * 複数の半直線について，それぞれ最も近くで交わるポリゴンを求めます
+         * @param rays 半直線の配列
+         * @param t_max 調べる距離の上限
+         * @param threads 使用するスレッド数．0ならハードウェアの並列数
+         * @return rays と同じ順に並んだ交点の配列
+         */
+        [[nodiscard]]
+        std::vector<STLRayHit> raycast_batch(
+            const std::vector<STLRay> &rays,
+            const float t_max = std::numeric_limits<float>::infinity(),
+            const unsigned int threads = 1
+        ) const {
+            std::vector<STLRayHit> hits(rays.size());
+            const std::size_t chunks = internal::thread_count(threads, rays.size(), internal::bvh_min_rays);
+            internal::parallel_chunks(rays.size(), chunks, [&](std::size_t, const std::size_t begin, const std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    hits[i] = raycast(rays[i], t_max);
+                }
+            });
+            return hits;
+        }
+
+        /**
+         * 平面 ax + by + cz + d = 0 と交わり得るポリゴンを列挙します
+         * @param a 平面の式のxの係数
+         * @param b 平面の式のyの係数
+         * @param c 平面の式のzの係数
+         * @param d 平面の式の定数
+         * @param f 並べ替えた後のポリゴンの番号を受け取る関数
+         * @details 包含箱の全体が平面の片側にある節点は調べません
+         */
+        template <class F>
+        void for_each_plane_candidate(const float a, const float b, const float c, const float d, F &&f) const {
+            if (polygons_.empty()) {
+                return;
+            }
+            std::uint32_t stack[internal::bvh_max_depth + 1];
+            std::size_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const internal::BVHNode &node = nodes_[stack[--top]];
+                // 平面の式の値が最小・最大になる角．丸めは各座標について単調なので頂点の値はこの範囲に収まる
+                const STLVector lo = { a < 0 ? node.box.max.x : node.box.min.x, b < 0 ? node.box.max.y : node.box.min.y, c < 0 ? node.box.max.z : node.box.min.z };
+                const STLVector hi = { a < 0 ? node.box.min.x : node.box.max.x, b < 0 ? node.box.min.y : node.box.max.y, c < 0 ? node.box.min.z : node.box.max.z };
+                if (internal::plane_distance(lo, a, b, c, d) >= 0 || internal::plane_distance(hi, a, b, c, d) < 0) {
+                    continue;
+                }
+                if (node.count > 0) {
+                    for (std::uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                        f(static_cast<std::size_t>(i));
+                    }
+                } else {
+                    stack[top++] = node.offset + 1;
+                    stack[top++] = node.offset;
+                }
+            }
+        }
+
+        /**
+         * ポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
+         * @param a 平面の式のxの係数
+         * @param b 平面の式のyの係数
+         * @param c 平面の式のzの係数
+         * @param d 平面の式の定数
+         * @return スライスして得られた線分の配列．葉の順に並びます
+         */
+        [[nodiscard]]
+        std::vector<STLSegment> slice_at(const float a, const float b, const float c, const float d) const {
+            STLUTIL_METRIC_SLICE();
+            std::vector<STLSegment> res;
+            for_each_plane_candidate(a, b, c, d, [this, &res, a, b, c, d](const std::size_t i) {
+                const auto &[ ignore, p, q, r ] = polygons_[i];
+                internal::slice_triangle(p, q, r, a, b, c, d, res);
+            });
+            return res;
+        }
+
+        /**
+         * @return ポリゴンの数
+         */
+        [[nodiscard]]
+        std::size_t size() const noexcept {
+            return polygons_.size();
+        }
+
+        /**
+         * @return 葉の順に並べ替えたポリゴンの配列
+         */
+        [[nodiscard]]
+        const auto &polygons() const noexcept {
+            return polygons_;
+        }
+
+        /**
+         * @return 並べ替えたポリゴンそれぞれの，元の配列での番号
+         */
+        [[nodiscard]]
+        const auto &indices() const noexcept {
+            return indices_;
+        }
+
+        /**
+         * @return 節点の配列．nodes()[0] が根
+         */
+        [[nodiscard]]
+        const auto &nodes() const noexcept {
+            return nodes_;
+        }
+    };
+
+    /**
+     * BVHを使ってポリゴンを ax + by + cz + d = 0 で表される平面でスライスします
+     * @param bvh スライスの対象となるBVH
+     * @param a 平面の式のxの係数
+     * @param b 平面の式のyの係数
+     * @param c 平面の式のzの係数
+     * @param d 平面の式の定数
+     * @return スライスして得られた線分の配列．得られる線分の集合は slice_polygons_at と同じですが，順序は異なります
+     */
+    [[nodiscard]]
+    inline std::vector<STLSegment> slice_polygons_at(
+        const STLBVH &bvh,
+        const float a, const float b, const float c, const float d
+    ) {
+        return bvh.slice_at(a, b, c, d);
     }
 }
@@ -0,0 +1,478 @@
+/**
+ * @file stlutil_cuda.cuh
+ * @brief stlutil.hpp のメッシュをCUDAで多数の平面でスライスするための拡張
+ * @author Shota Minami
+ * @details nvcc でコンパイルする場合にだけ include してください．stlutil.hpp 自体はCUDAに依存しません．
+ * 変更した場合は bench/stlutil_cuda_parity.cu をGPUのある環境でビルドして実行し，CPUの結果と一致することを確認してください
+ */
+#pragma once
+
+#ifndef __CUDACC__
+#error "stlutil_cuda.cuh must be compiled with nvcc"
+#endif
+
+#include "stlutil.hpp"
+
+#include <cuda_runtime.h>
+
+namespace stlutil {
+
+    namespace cuda {
+
+        namespace internal {
+
+            constexpr unsigned int block_size = 256; // カーネルの1ブロックあたりのスレッド数
+            constexpr unsigned int max_blocks = 65535; // カーネルのブロック数の上限．超える分は各スレッドが繰り返し処理する
+
+            /**
+             * デバイス上に確保した配列
+             * @tparam T 要素の型
+             */
+            template <class T>
+            struct DeviceBuffer {
+            private:
+                T *data_ = nullptr; // 配列の先頭
+                std::size_t size_ = 0; // 要素の数
+
+            public:
+                DeviceBuffer() noexcept = default;
+                DeviceBuffer(const DeviceBuffer &) = delete;
+                DeviceBuffer &operator=(const DeviceBuffer &) = delete;
+
+                DeviceBuffer(DeviceBuffer &&other) noexcept
+                    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+                DeviceBuffer &operator=(DeviceBuffer &&other) noexcept {
+                    if (this != &other) {
+                        release();
+                        data_ = std::exchange(other.data_, nullptr);
+                        size_ = std::exchange(other.size_, 0);
+                    }
+                    return *this;
+                }
+
+                ~DeviceBuffer() {
+                    release();
+                }
+
+                /**
+                 * 配列を確保し直します．中身は不定です
+                 * @param n 要素の数
+                 * @return CUDAのエラー
+                 */
+                cudaError_t allocate(const std::size_t n) noexcept {
+                    release();
+                    if (n == 0) {
+                        return cudaSuccess;
+                    }
+                    const cudaError_t error = cudaMalloc(reinterpret_cast<void **>(&data_), n * sizeof(T));
+                    if (error != cudaSuccess) {
+                        data_ = nullptr;
+                        return error;
+                    }
+                    size_ = n;
+                    return cudaSuccess;
+                }
+
+                /**
+                 * 配列を確保してホストの配列を転送します
+                 * @param src ホストの配列の先頭
+                 * @param n 要素の数
+                 * @return CUDAのエラー
+                 */
+                cudaError_t upload(const T *src, const std::size_t n) noexcept {
+                    const cudaError_t error = allocate(n);
+                    if (error != cudaSuccess || n == 0) {
+                        return error;
+                    }
+                    return cudaMemcpy(data_, src, n * sizeof(T), cudaMemcpyHostToDevice);
+                }
+
+                /**
+                 * 配列を解放します
+                 */
+                void release() noexcept {
+                    if (data_ != nullptr) {
+                        cudaFree(data_);
+                    }
+                    data_ = nullptr;
+                    size_ = 0;
+                }
+
+                /**
+                 * @return 配列の先頭
+                 */
+                [[nodiscard]]
+                T *data() const noexcept {
+                    return data_;
+                }
+
+                /**
+                 * @return 要素の数
+                 */
+                [[nodiscard]]
+                std::size_t size() const noexcept {
+                    return size_;
+                }
+            };
+
+            /**
+             * 成分ごとの配列で保持されたデバイス上のメッシュ
+             */
+            struct SoAView {
+                const float *x[3]; // 頂点1, 2, 3 のx座標の配列
+                const float *y[3]; // 頂点1, 2, 3 のy座標の配列
+                const float *z[3]; // 頂点1, 2, 3 のz座標の配列
+
+                /**
+                 * @param i ポリゴンの番号
+                 * @param v 3頂点の格納先
+                 */
+                __device__ void triangle(const std::size_t i, STLVector (&v)[3]) const noexcept {
+                    for (int slot = 0; slot < 3; ++slot) {
+                        v[slot] = { __ldg(x[slot] + i), __ldg(y[slot] + i), __ldg(z[slot] + i) };
+                    }
+                }
+            };
+
+            /**
+             * 頂点の配列と添字の配列で保持されたデバイス上のメッシュ
+             */
+            struct IndexedView {
+                const STLVector *vertices; // 頂点の配列
+                const std::uint32_t *indices; // ポリゴンごとの3頂点の添字の配列
+
+                /**
+                 * @param i ポリゴンの番号
+                 * @param v 3頂点の格納先
+                 */
+                __device__ void triangle(const std::size_t i, STLVector (&v)[3]) const noexcept {
+                    for (int slot = 0; slot < 3; ++slot) {
+                        v[slot] = vertices[__ldg(indices + 3 * i + slot)];
+                    }
+                }
+            };
+
+            /**
+             * 三角形を平面 z = const でスライスします
+             * @param v 三角形の頂点
+             * @param z 平面のz座標
+             * @param segment 得られた線分の格納先
+             * @return 線分が得られたらtrue
+             * @details stlutil::internal::slice_triangle_at を AxisPlane<STLAxis::z> で呼んだ場合と同じ線分を返します．
+             * CPUと同じ値になるよう，積和を1つの命令にまとめない丸めを指定して計算します
+             */
+            __device__ inline bool slice_triangle_z(const STLVector (&v)[3], const float z, STLSegment &segment) noexcept {
+                const float dist[3] = { __fsub_rn(v[0].z, z), __fsub_rn(v[1].z, z), __fsub_rn(v[2].z, z) };
+                if (isnan(dist[0]) || isnan(dist[1]) || isnan(dist[2])) {
+                    return false;
+                }
+                bool crossed = false;
+                for (int i = 0; i < 3; ++i) {
+                    const int j = i == 2 ? 0 : i + 1;
+                    const bool above = dist[i] >= 0;
+                    if (above == (dist[j] >= 0)) {
+                        continue;
+                    }
+                    const int lo = above ? j : i; // 下側の頂点
+                    const int hi = above ? i : j; // 上側の頂点
+                    const float t = __fdiv_rn(dist[lo], __fsub_rn(dist[lo], dist[hi]));
+                    const float s = __fsub_rn(1.0f, t);
+                    const STLVector point {
+                        __fadd_rn(__fmul_rn(s, v[lo].x), __fmul_rn(t, v[hi].x)),
+                        __fadd_rn(__fmul_rn(s, v[lo].y), __fmul_rn(t, v[hi].y)),
+                        z
+                    };
+                    (above ? segment.p : segment.q) = point;
+                    crossed = true;
+                }
+                if (!crossed) {
+                    return false;
+                }
+                const auto &alpha = segment.p;
+                const auto &beta = segment.q;
+                if (alpha.x == beta.x && alpha.y == beta.y) {
+                    return false;
+                }
+                return !(isnan(alpha.x) || isnan(alpha.y) || isnan(beta.x) || isnan(beta.y));
+            }
+
+            /**
+             * 昇順に並んだ配列から value より大きい最初の要素を探します
+             * @param levels 昇順に並んだ配列
+             * @param count 要素の数
+             * @param value 探す値
+             * @return 見つかった要素の番号．無ければ count
+             */
+            __device__ inline unsigned int upper_bound(const float *levels, const unsigned int count, const float value) noexcept {
+                unsigned int lo = 0, hi = count;
+                while (lo < hi) {
+                    const unsigned int mid = lo + (hi - lo) / 2;
+                    if (__ldg(levels + mid) <= value) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                return lo;
+            }
+
+            /**
+             * 平面ごとに得られる線分の数を数える出力先
+             */
+            struct CountSink {
+                unsigned int *counts; // 平面ごとの線分の数
+
+                __device__ void operator()(const unsigned int k, const STLSegment &) const noexcept {
+                    atomicAdd(counts + k, 1u);
+                }
+            };
+
+            /**
+             * 平面ごとの区間に線分を追記する出力先
+             */
+            struct FillSink {
+                const unsigned long long *offsets; // 平面ごとの区間の先頭
+                unsigned int *cursors; // 平面ごとの書き込み済みの線分の数
+                STLSegment *out; // 線分の格納先
+
+                __device__ void operator()(const unsigned int k, const STLSegment &segment) const noexcept {
+                    out[offsets[k] + atomicAdd(cursors + k, 1u)] = segment;
+                }
+            };
+
+            /**
+             * ポリゴンをそのz座標の範囲に含まれる平面でスライスし，得られた線分を出力先に渡します
+             * @param mesh デバイス上のメッシュ
+             * @param i ポリゴンの番号
+             * @param levels 昇順に並んだ平面のz座標の配列
+             * @param count 平面の数
+             * @param sink (平面の番号, 線分) を受け取る出力先
+             */
+            template <class View, class Sink>
+            __device__ void for_each_segment(
+                const View &mesh, const std::size_t i,
+                const float *levels, const unsigned int count, const Sink &sink
+            ) {
+                STLVector v[3];
+                mesh.triangle(i, v);
+                const float lo = fminf(v[0].z, fminf(v[1].z, v[2].z));
+                const float hi = fmaxf(v[0].z, fmaxf(v[1].z, v[2].z));
+                // 平面をまたぐのは lo < z <= hi の場合だけ
+                for (unsigned int k = upper_bound(levels, count, lo); k < count && __ldg(levels + k) <= hi; ++k) {
+                    STLSegment segment;
+                    if (slice_triangle_z(v, __ldg(levels + k), segment)) {
+                        sink(k, segment);
+                    }
+                }
+            }
+
+            /**
+             * 全てのポリゴンを複数の平面でスライスし，得られた線分を出力先に渡します
+             * @tparam View デバイス上のメッシュの型 (SoAView または IndexedView)
+             * @tparam Sink 出力先の型 (CountSink または FillSink)
+             */
+            template <class View, class Sink>
+            __global__ void slice_levels(
+                const View mesh, const std::size_t n,
+                const float *levels, const unsigned int count,
+                const Sink sink
+            ) {
+                const std::size_t stride = static_cast<std::size_t>(gridDim.x) * blockDim.x;
+                for (std::size_t i = static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x; i < n; i += stride) {
+                    for_each_segment(mesh, i, levels, count, sink);
+                }
+            }
+
+            /**
+             * @param n 処理する要素の数
+             * @return カーネルのブロック数
+             */
+            [[nodiscard]]
+            inline unsigned int grid_size(const std::size_t n) noexcept {
+                return static_cast<unsigned int>(std::max<std::size_t>(1, std::min<std::size_t>((n + block_size - 1) / block_size, max_blocks)));
+            }
+        }
+
+        /**
+         * デバイスに転送したメッシュ
+         * @details 転送は作成時の1回だけで，多数のz座標でのスライスをデバイス上で行います
+         */
+        struct STLCudaMesh {
+        private:
+            internal::DeviceBuffer<float> coordinates_; // 成分ごとの座標の配列 (x1, x2, x3, y1, ..., z3 の順)
+            internal::DeviceBuffer<STLVector> vertices_; // 頂点の配列
+            internal::DeviceBuffer<std::uint32_t> indices_; // ポリゴンごとの3頂点の添字の配列
+            std::size_t size_ = 0; // ポリゴンの数
+            bool indexed_ = false; // 頂点の配列と添字の配列で保持しているかどうか
+
+            bool valid = false; // 転送が正常に行えたかどうか
+
+            /**
+             * CUDAのエラーを確認し，失敗していれば出力します
+             * @param error CUDAのエラー
+             * @param method エラーの出力に使う関数名
+             * @return 成功していればtrue
+             */
+            static bool check(const cudaError_t error, const char *method) {
+                if (error != cudaSuccess) {
+                    std::cerr << "STLCudaMesh::" << method << " Error: " << cudaGetErrorString(error) << std::endl;
+                    return false;
+                }
+                return true;
+            }
+
+            /**
+             * デバイス上のメッシュの形式に応じてスライスのカーネルを起動します
+             * @param levels 昇順に並んだ平面のz座標のデバイス上の配列
+             * @param count 平面の数
+             * @param sink 線分の出力先
+             */
+            template <class Sink>
+            void launch(const float *levels, const unsigned int count, const Sink &sink) const {
+                const unsigned int grid = internal::grid_size(size_);
+                if (indexed_) {
+                    const internal::IndexedView view { vertices_.data(), indices_.data() };
+                    internal::slice_levels<internal::IndexedView, Sink><<<grid, internal::block_size>>>(view, size_, levels, count, sink);
+                } else {
+                    const float *base = coordinates_.data();
+                    internal::SoAView view {};
+                    for (int slot = 0; slot < 3; ++slot) {
+                        view.x[slot] = base + (0 + slot) * size_;
+                        view.y[slot] = base + (3 + slot) * size_;
+                        view.z[slot] = base + (6 + slot) * size_;
+                    }
+                    internal::slice_levels<internal::SoAView, Sink><<<grid, internal::block_size>>>(view, size_, levels, count, sink);
+                }
+            }
+
+        public:
+            /**
+             * 成分ごとの配列で保持されたメッシュを転送します
+             * @param mesh 転送するメッシュ
+             */
+            explicit STLCudaMesh(const STLMeshSoA &mesh) : size_(mesh.size()) {
+                std::vector<float> host(9 * size_);
+                for (std::size_t slot = 0; slot < 3; ++slot) {
+                    std::copy(mesh.x(slot).begin(), mesh.x(slot).end(), host.begin() + (0 + slot) * size_);
+                    std::copy(mesh.y(slot).begin(), mesh.y(slot).end(), host.begin() + (3 + slot) * size_);
+                    std::copy(mesh.z(slot).begin(), mesh.z(slot).end(), host.begin() + (6 + slot) * size_);
+                }
+                valid = check(coordinates_.upload(host.data(), host.size()), "STLCudaMesh()");
+            }
+
+            /**
+             * ポリゴンの配列を成分ごとの配列にして転送します
+             * @param polygons 転送するポリゴンの配列
+             */
+            explicit STLCudaMesh(const std::vector<STLPolygon> &polygons) : STLCudaMesh(STLMeshSoA(polygons)) {}
+
+            /**
+             * 頂点の配列と添字の配列で保持されたメッシュを転送します
+             * @param mesh 転送するメッシュ
+             * @details 頂点を共有するので，成分ごとの配列よりデバイスのメモリを節約できます
+             */
+            explicit STLCudaMesh(const STLIndexedMesh &mesh) : size_(mesh.size()), indexed_(true) {
+                valid = check(vertices_.upload(mesh.vertices().data(), mesh.vertices().size()), "STLCudaMesh()")
+                    && check(indices_.upload(mesh.indices().data(), mesh.indices().size()), "STLCudaMesh()");
+            }
+
+            /**
+             * @return 転送が正常に行えていたらtrue，そうでなければfalse
+             */
+            explicit operator bool() const noexcept {
+                return valid;
+            }
+
+            /**
+             * @return ポリゴンの数
+             */
+            [[nodiscard]]
+            std::size_t size() const noexcept {
+                return size_;
+            }
+
+            /**
+             * メッシュをz軸に垂直な複数の平面でスライスします
+             * @param levels スライスを行うz座標の配列
+             * @param res z座標ごとのスライスして得られた線分の配列の格納先．levels と同じ順に並びます
+             * @return 正常にスライスできたらtrue．失敗した場合 res は空になります
+             * @details 平面ごとの線分の数を数えてから，平面ごとの区間にアトミックな加算で位置を決めて書き込みます．
+             * 得られる線分は stlutil::slice_polygons_at_z_levels と同じですが，平面ごとの線分の順序は不定です
+             */
+            bool slice_at_z_levels(const std::vector<float> &levels, std::vector<std::vector<STLSegment>> &res) const {
+                res.clear();
+                if (!valid) {
+                    return false;
+                }
+                res.resize(levels.size());
+                if (size_ == 0 || levels.empty()) {
+                    return true;
+                }
+                const stlutil::internal::ZLevelSlicer slicer(levels);
+                const auto count = static_cast<unsigned int>(levels.size());
+                constexpr const char *method = "slice_at_z_levels()";
+
+                internal::DeviceBuffer<float> sorted;
+                internal::DeviceBuffer<unsigned int> counts;
+                if (!check(sorted.upload(slicer.sorted.data(), count), method)
+                    || !check(counts.allocate(count), method)
+                    || !check(cudaMemset(counts.data(), 0, count * sizeof(unsigned int)), method)) {
+                    res.clear();
+                    return false;
+                }
+                launch(sorted.data(), count, internal::CountSink { counts.data() });
+                std::vector<unsigned int> host_counts(count);
+                if (!check(cudaGetLastError(), method)
+                    || !check(cudaMemcpy(host_counts.data(), counts.data(), count * sizeof(unsigned int), cudaMemcpyDeviceToHost), method)) {
+                    res.clear();
+                    return false;
+                }
+
+                std::vector<unsigned long long> offsets(count + 1, 0);
+                for (unsigned int k = 0; k < count; ++k) {
+                    offsets[k + 1] = offsets[k] + host_counts[k];
+                }
+                const std::size_t total = offsets.back();
+                if (total == 0) {
+                    return true;
+                }
+                internal::DeviceBuffer<unsigned long long> device_offsets;
+                internal::DeviceBuffer<STLSegment> out;
+                if (!check(device_offsets.upload(offsets.data(), count), method)
+                    || !check(cudaMemset(counts.data(), 0, count * sizeof(unsigned int)), method)
+                    || !check(out.allocate(total), method)) {
+                    res.clear();
+                    return false;
+                }
+                launch(sorted.data(), count, internal::FillSink { device_offsets.data(), counts.data(), out.data() });
+                std::vector<STLSegment> segments(total);
+                if (!check(cudaGetLastError(), method)
+                    || !check(cudaMemcpy(segments.data(), out.data(), total * sizeof(STLSegment), cudaMemcpyDeviceToHost), method)) {
+                    res.clear();
+                    return false;
+                }
+                for (unsigned int k = 0; k < count; ++k) {
+                    res[slicer.order[k]].assign(segments.begin() + offsets[k], segments.begin() + offsets[k + 1]);
+                }
+                return true;
+            }
+        };
+
+        /**
+         * デバイスに転送したメッシュをz軸に垂直な複数の平面でスライスします
+         * @param mesh スライスの対象となるメッシュ
+         * @param levels スライスを行うz座標の配列
+         * @return z座標ごとのスライスして得られた線分の配列．levels と同じ順に並びます．失敗した場合は空
+         */
+        [[nodiscard]]
+        inline std::vector<std::vector<STLSegment>> slice_polygons_at_z_levels(
+            const STLCudaMesh &mesh,
+            const std::vector<float> &levels
+        ) {
+            std::vector<std::vector<STLSegment>> res;
+            mesh.slice_at_z_levels(levels, res);
+            return res;
+        }
+    }
+}